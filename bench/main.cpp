@@ -0,0 +1,425 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMouseEvent>
+#include <QRandomGenerator>
+#include <QScreen>
+#include <QTemporaryDir>
+#include <QThreadPool>
+#include <QTimer>
+#include <QTextStream>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#ifdef Q_OS_WIN
+#include <malloc.h>
+#endif
+#include "boardfile.h"
+#include "canvas.h"
+#include "mainwindow.h"
+
+// Headless rendering benchmark. Drives Canvas on the offscreen platform with synthetic
+// boards and reports paint time percentiles and heap allocations per frame as JSON,
+// so regressions in the paint path show up as numbers. It also times the window from
+// construction, and from a resident show, to its first frame. Allocations are counted
+// process-wide, so frames that wait on tile workers include theirs.
+
+namespace {
+
+std::atomic<quint64> g_allocations { 0 };
+
+// A window that hasn't painted by then counts as a failed run
+constexpr int FIRST_PAINT_TIMEOUT_MS = 5000;
+
+struct Series {
+    QVector<double> ms;
+    QVector<quint64> allocations;
+};
+
+double percentile(QVector<double> sorted, double p)
+{
+    if (sorted.isEmpty()) return 0;
+    std::sort(sorted.begin(), sorted.end());
+    const int index = std::clamp(int(std::ceil(p * sorted.size())) - 1, 0, int(sorted.size()) - 1);
+    return sorted[index];
+}
+
+QJsonObject percentiles(const QVector<double> &ms)
+{
+    double total = 0;
+    for (double value : ms) total += value;
+    return {
+        { "p50", percentile(ms, 0.50) },
+        { "p90", percentile(ms, 0.90) },
+        { "p99", percentile(ms, 0.99) },
+        { "max", percentile(ms, 1.0) },
+        { "mean", ms.isEmpty() ? 0.0 : total / ms.size() }
+    };
+}
+
+QJsonObject summarize(const Series &series)
+{
+    quint64 allocations = 0, maxAllocations = 0;
+    for (quint64 count : series.allocations) {
+        allocations += count;
+        maxAllocations = std::max(maxAllocations, count);
+    }
+    const int frames = int(series.ms.size());
+    return {
+        { "frames", frames },
+        { "paint_ms", percentiles(series.ms) },
+        { "allocations_per_frame", QJsonObject {
+            { "mean", frames ? double(allocations) / frames : 0.0 },
+            { "max", double(maxAllocations) } } }
+    };
+}
+
+// Waits for tile workers and delivers their results, so the next frame is complete
+void settle()
+{
+    for (int i = 0; i < 3; ++i) {
+        QThreadPool::globalInstance()->waitForDone();
+        QCoreApplication::processEvents();
+    }
+}
+
+void measureFrame(Canvas *canvas, Series *series)
+{
+    const quint64 allocations = g_allocations.load(std::memory_order_relaxed);
+    QElapsedTimer timer;
+    timer.start();
+    canvas->repaint();
+    series->ms.append(timer.nsecsElapsed() / 1e6);
+    series->allocations.append(g_allocations.load(std::memory_order_relaxed) - allocations);
+}
+
+QColor randomColor(QRandomGenerator &rng)
+{
+    return QColor::fromHsv(rng.bounded(360), 128 + rng.bounded(128), 255, 128 + rng.bounded(128));
+}
+
+QVector<QPoint> randomWalk(QRandomGenerator &rng, const QSize &size, int points, int step)
+{
+    QVector<QPoint> path;
+    QPoint point(rng.bounded(size.width()), rng.bounded(size.height()));
+    for (int i = 0; i < points; ++i) {
+        point += QPoint(rng.bounded(-step, step + 1), rng.bounded(-step, step + 1));
+        path.append(point);
+    }
+    return path;
+}
+
+StrokeStore freehandBoard(QRandomGenerator &rng, const QSize &size, int strokes)
+{
+    StrokeStore store;
+    for (int i = 0; i < strokes; ++i) {
+        const QVector<QPoint> path = randomWalk(rng, size, 20 + rng.bounded(60), 12);
+        store.append({ path.constData(), int(path.size()), randomColor(rng), 2 + rng.bounded(7), Tool::Pen, QString(), 0 });
+    }
+    return store;
+}
+
+StrokeStore textBoard(QRandomGenerator &rng, const QSize &size, int texts)
+{
+    static const QStringList words = { "TODO", "check this", "42", "see above", "→ next step", "why?", "v2 layout", "ok" };
+    StrokeStore store;
+    for (int i = 0; i < texts; ++i) {
+        const QPoint point(rng.bounded(size.width()), rng.bounded(size.height()));
+        store.append({ &point, 1, randomColor(rng), 0, Tool::Text, words[rng.bounded(int(words.size()))], 12 + rng.bounded(37) });
+    }
+    return store;
+}
+
+// Pen strokes with pixel erasing over them, and object erasing every few strokes
+StrokeStore eraserBoard(QRandomGenerator &rng, const QSize &size, int strokes)
+{
+    StrokeStore store;
+    for (int i = 0; i < strokes; ++i) {
+        const bool erasing = i % 3 == 2;
+        const QVector<QPoint> path = randomWalk(rng, size, 20 + rng.bounded(60), erasing ? 20 : 12);
+        store.append({ path.constData(), int(path.size()), randomColor(rng), erasing ? 24 : 2 + rng.bounded(7),
+                       erasing ? Tool::Eraser : Tool::Pen, QString(), 0 });
+        if (i % 10 == 9) {
+            store.appendErase();
+            for (int k = 0; k < 3; ++k) {
+                const int target = rng.bounded(store.count() - 1);
+                if (store.tool(target) != Tool::ObjectEraser && !store.isErased(target)) store.eraseStroke(target);
+            }
+        }
+    }
+    return store;
+}
+
+QJsonObject boardWorkload(Canvas *canvas, const QString &name, const StrokeStore &board, const QString &path,
+                          int coldRuns, int frames)
+{
+    if (!BoardFile::save(path, board, QImage())) qFatal("Cannot write %s", qPrintable(path));
+
+    // Cold: from a freshly loaded board to a complete frame, tiles rendered from scratch
+    Series cold;
+    for (int run = 0; run < coldRuns; ++run) {
+        canvas->loadBoard(path);
+        const quint64 allocations = g_allocations.load(std::memory_order_relaxed);
+        QElapsedTimer timer;
+        timer.start();
+        canvas->repaint();
+        settle();
+        canvas->repaint();
+        cold.ms.append(timer.nsecsElapsed() / 1e6);
+        cold.allocations.append(g_allocations.load(std::memory_order_relaxed) - allocations);
+    }
+
+    // Warm: full-window repaints with every tile cached
+    Series warm;
+    for (int i = 0; i < frames; ++i) {
+        measureFrame(canvas, &warm);
+    }
+
+    return { { "name", name }, { "entries", board.count() }, { "cold", summarize(cold) }, { "warm", summarize(warm) } };
+}
+
+QJsonObject liveStrokeWorkload(Canvas *canvas, QRandomGenerator &rng, int points, int movesPerFrame)
+{
+    canvas->clearCanvas();
+    canvas->setTool(Tool::Pen);
+    settle();
+
+    const QVector<QPoint> path = randomWalk(rng, canvas->size(), points, 6);
+    auto send = [canvas](QEvent::Type type, const QPoint &point, Qt::MouseButtons buttons) {
+        QMouseEvent event(type, point, canvas->mapToGlobal(point), Qt::LeftButton, buttons, Qt::NoModifier);
+        QApplication::sendEvent(canvas, &event);
+    };
+
+    // One frame per batch of moves, as a fast mouse delivers them between vsyncs
+    Series series;
+    send(QEvent::MouseButtonPress, path.first(), Qt::LeftButton);
+    for (int i = 1; i < path.size(); ++i) {
+        send(QEvent::MouseMove, path[i], Qt::LeftButton);
+        if (i % movesPerFrame == 0) measureFrame(canvas, &series);
+    }
+    send(QEvent::MouseButtonRelease, path.last(), Qt::NoButton);
+    measureFrame(canvas, &series);
+    settle();
+
+    return { { "name", "live-stroke" }, { "points", points }, { "frames", summarize(series) } };
+}
+
+// Runs `show` and waits for the frame it leads to, as timed by the window itself
+double waitForFirstPaint(MainWindow *window, const std::function<void()> &show)
+{
+    double ms = -1;
+    QEventLoop loop;
+    QObject::connect(window, &MainWindow::firstPainted, &loop, [&](qreal elapsed) {
+        ms = elapsed;
+        loop.quit();
+    });
+    QTimer::singleShot(FIRST_PAINT_TIMEOUT_MS, &loop, &QEventLoop::quit);
+    show();
+    loop.exec();
+    if (ms < 0) qWarning() << "No frame within" << FIRST_PAINT_TIMEOUT_MS << "ms";
+    return ms;
+}
+
+// Construction to first frame, with the help panel up front and with --clean, then
+// hide and show cycles as a resident instance sees them. Qt is already up, so this is
+// the application's share of a launch.
+QJsonObject startupWorkload(int runs)
+{
+    QVariantMap options { { "never-save", true }, { "daemon", true } };
+    QVector<double> help, clean, shows;
+    for (int run = 0; run < runs; ++run) {
+        for (bool withHelp : { true, false }) {
+            if (withHelp) options.remove("clean"); else options["clean"] = true;
+            QElapsedTimer clock;
+            clock.start();
+            MainWindow window(options);
+            const double ms = waitForFirstPaint(&window, [&] {
+                window.measureFirstPaint(clock);
+                window.show();
+            });
+            if (ms >= 0) (withHelp ? help : clean).append(ms);
+            if (withHelp) continue;
+
+            window.handleCommand("hide");
+            settle();
+            const double showMs = waitForFirstPaint(&window, [&] { window.handleCommand("show"); });
+            if (showMs >= 0) shows.append(showMs);
+            window.handleCommand("hide");
+            settle();
+        }
+    }
+
+    const double refreshRate = QGuiApplication::primaryScreen()->refreshRate();
+    return {
+        { "name", "startup" },
+        { "runs", runs },
+        { "help_panel_ms", percentiles(help) },
+        { "clean_ms", percentiles(clean) },
+        { "show_ms", percentiles(shows) },
+        { "frame_budget_ms", refreshRate > 0 ? 1000 / refreshRate : 1000 / 60.0 }
+    };
+}
+
+} // namespace
+
+// Every replaceable allocation form is counted: the plain and nothrow ones here, the
+// over-aligned ones below. The array forms forward to these by default.
+void *operator new(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    std::free(p);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    const std::size_t align = std::max(std::size_t(alignment), sizeof(void *));
+    // aligned_alloc wants a multiple of the alignment
+    const std::size_t rounded = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+#ifdef Q_OS_WIN
+    if (void *p = _aligned_malloc(rounded, align)) return p;
+#else
+    if (void *p = std::aligned_alloc(align, rounded)) return p;
+#endif
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    try {
+        return operator new(size, alignment);
+    } catch (const std::bad_alloc &) {
+        return nullptr;
+    }
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+#ifdef Q_OS_WIN
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(p, alignment);
+}
+
+void operator delete(void *p, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    operator delete(p, alignment);
+}
+
+int main(int argc, char *argv[])
+{
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication a(argc, argv);
+    QCoreApplication::setApplicationName("crystalboard-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures CrystalBoard's paint path on synthetic boards.");
+    parser.addHelpOption();
+
+    QCommandLineOption framesOption("frames", "Warm frames measured per board.", "count", "200");
+    parser.addOption(framesOption);
+
+    QCommandLineOption coldRunsOption("cold-runs", "Times each board is loaded and rendered from scratch.", "count", "5");
+    parser.addOption(coldRunsOption);
+
+    QCommandLineOption startupRunsOption("startup-runs", "Times the window is built and shown for the startup workload.", "count", "10");
+    parser.addOption(startupRunsOption);
+
+    QCommandLineOption sizeOption("size", "Canvas size.", "WxH", "1920x1080");
+    parser.addOption(sizeOption);
+
+    QCommandLineOption outputOption({"o", "output"}, "Write the JSON report here instead of to stdout.", "file");
+    parser.addOption(outputOption);
+
+    parser.process(a);
+
+    const QStringList dimensions = parser.value(sizeOption).split('x');
+    const QSize size(dimensions.value(0).toInt(), dimensions.value(1).toInt());
+    if (size.isEmpty()) parser.showHelp(1);
+    const int frames = std::max(1, parser.value(framesOption).toInt());
+    const int coldRuns = std::max(1, parser.value(coldRunsOption).toInt());
+    const int startupRuns = std::max(1, parser.value(startupRunsOption).toInt());
+    // Windows come and go during the startup workload
+    QApplication::setQuitOnLastWindowClosed(false);
+
+    QTemporaryDir dir;
+    if (!dir.isValid()) qFatal("Cannot create a temporary directory");
+
+    Canvas canvas;
+    // Keep every stroke live so paint cost follows the board size rather than the flattening policy
+    canvas.setHistoryDepth(0);
+    canvas.setHistoryBudget(0);
+    canvas.setInitialPenWidth(4);
+    canvas.setPenColor(QColor(255, 255, 255, 200));
+    canvas.resize(size);
+    canvas.show();
+    settle();
+
+    QRandomGenerator rng(20240611);
+    const QString board = dir.filePath("board.crb");
+    QJsonArray workloads;
+    workloads.append(boardWorkload(&canvas, "freehand-10k", freehandBoard(rng, size, 10000), board, coldRuns, frames));
+    workloads.append(boardWorkload(&canvas, "text-heavy", textBoard(rng, size, 2000), board, coldRuns, frames));
+    workloads.append(boardWorkload(&canvas, "eraser-heavy", eraserBoard(rng, size, 6000), board, coldRuns, frames));
+    workloads.append(liveStrokeWorkload(&canvas, rng, 20000, 8));
+    canvas.hide();
+    workloads.append(startupWorkload(startupRuns));
+
+    const QJsonObject report {
+        { "platform", QGuiApplication::platformName() },
+        { "width", size.width() },
+        { "height", size.height() },
+        { "workloads", workloads }
+    };
+    const QByteArray json = QJsonDocument(report).toJson();
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+            qWarning() << "Cannot write" << file.fileName();
+            return 1;
+        }
+    } else {
+        QTextStream(stdout) << json;
+    }
+    return 0;
+}
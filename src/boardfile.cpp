@@ -0,0 +1,200 @@
+#include "boardfile.h"
+#include "varint.h"
+#include <QBuffer>
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+bool parseEntry(Varint::Reader &in, StrokeStore *strokes)
+{
+    quint64 style;
+    const uchar *rgba;
+    if (!in.readVarint(&style) || !in.readBytes(4, &rgba)) return false;
+    const Tool tool = static_cast<Tool>(style & 0xFF);
+    const int size = int(style >> 8);
+    if ((style & 0xFF) > quint64(Tool::Circle)) return false;
+
+    if (tool == Tool::ObjectEraser) {
+        int erasedCount;
+        if (!in.readCount(&erasedCount, 1)) return false;
+        strokes->appendErase();
+        qint64 id = 0;
+        for (int i = 0; i < erasedCount; ++i) {
+            qint64 delta;
+            if (!in.readSigned(&delta)) return false;
+            id += delta;
+            if (id < 0 || id >= strokes->count() - 1) return false;
+            strokes->eraseStroke(int(id));
+        }
+        return true;
+    }
+
+    int pointCount;
+    if (!in.readCount(&pointCount, 2)) return false;
+    QVector<QPoint> points(pointCount);
+    qint64 x = 0, y = 0;
+    for (QPoint &point : points) {
+        qint64 dx, dy;
+        if (!in.readSigned(&dx) || !in.readSigned(&dy)) return false;
+        x += dx;
+        y += dy;
+        point = QPoint(int(x), int(y));
+    }
+
+    QString text;
+    if (tool == Tool::Text) {
+        int textSize;
+        const uchar *utf8;
+        if (!in.readCount(&textSize, 1) || !in.readBytes(textSize, &utf8)) return false;
+        text = QString::fromUtf8(reinterpret_cast<const char *>(utf8), textSize);
+    }
+
+    const QColor color = QColor::fromRgba(qFromLittleEndian<quint32>(rgba));
+    strokes->append({ points.constData(), int(points.size()), color,
+                      tool == Tool::Text ? 0 : size, tool, text, tool == Tool::Text ? size : 0 });
+    return true;
+}
+
+bool parse(Varint::Reader &in, StrokeStore *strokes, QImage *base)
+{
+    const uchar *header;
+    if (!in.readBytes(8, &header) || std::memcmp(header, BoardFile::MAGIC, 4) != 0) return false;
+    if (qFromLittleEndian<quint16>(header + 4) > BoardFile::VERSION) {
+        qWarning() << "Board file was written by a newer version";
+        return false;
+    }
+
+    // Base layer: device pixel ratio in thousandths, then a PNG (empty if there is none)
+    quint64 dprMilli;
+    int pngSize;
+    const uchar *png;
+    if (!in.readVarint(&dprMilli) || !in.readCount(&pngSize, 1) || !in.readBytes(pngSize, &png)) return false;
+    if (pngSize > 0) {
+        *base = QImage::fromData(png, pngSize, "PNG").convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        if (base->isNull()) return false;
+        base->setDevicePixelRatio(std::max<quint64>(dprMilli, 1) / 1000.0);
+    }
+
+    int entryCount;
+    if (!in.readCount(&entryCount, 3)) return false;
+    for (int entry = 0; entry < entryCount; ++entry) {
+        if (!parseEntry(in, strokes)) return false;
+    }
+    return in.remaining() == 0;
+}
+
+} // namespace
+
+bool BoardFile::save(const QString &path, const StrokeStore &strokes, const QImage &base)
+{
+    QByteArray out;
+    out.append(MAGIC, 4);
+    char fields[4];
+    qToLittleEndian<quint16>(VERSION, fields);
+    qToLittleEndian<quint16>(0, fields + 2); // Flags, reserved
+    out.append(fields, 4);
+
+    QByteArray png;
+    if (!base.isNull()) {
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        // Otherwise the board would be written, and reported saved, without its base layer
+        if (!base.save(&buffer, "PNG")) {
+            qWarning() << "Could not save board to" << path << ": cannot encode the base layer";
+            return false;
+        }
+    }
+    Varint::write(out, quint64(qRound(base.devicePixelRatio() * 1000)));
+    Varint::write(out, quint64(png.size()));
+    out.append(png);
+
+    // The redo stack is not part of the board
+    Varint::write(out, quint64(strokes.count()));
+    for (int i = 0; i < strokes.count(); ++i) {
+        writeEntry(out, strokes, i);
+    }
+
+    // Written to a temporary file and renamed, so a failed save never leaves half a board behind
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(out) != out.size() || !file.commit()) {
+        qWarning() << "Could not save board to" << path << ":" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool BoardFile::load(const QString &path, StrokeStore *strokes, QImage *base)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not open board" << path << ":" << file.errorString();
+        return false;
+    }
+
+    // Mapped, so opening a large board doesn't copy it through a read buffer first
+    QByteArray fallback;
+    qint64 size = file.size();
+    const uchar *data = file.map(0, size);
+    if (!data) {
+        fallback = file.readAll();
+        data = reinterpret_cast<const uchar *>(fallback.constData());
+        size = fallback.size();
+    }
+
+    StrokeStore loaded;
+    QImage loadedBase;
+    Varint::Reader in(data, size);
+    if (!parse(in, &loaded, &loadedBase)) {
+        qWarning() << "Not a valid board file:" << path;
+        return false;
+    }
+    *strokes = loaded;
+    *base = loadedBase;
+    return true;
+}
+
+void BoardFile::writeEntry(QByteArray &out, const StrokeStore &strokes, int index)
+{
+    const StrokeView stroke = strokes.at(index);
+    const int size = stroke.tool == Tool::Text ? stroke.textSize : stroke.penWidth;
+    Varint::write(out, quint64(static_cast<int>(stroke.tool)) | (quint64(size) << 8));
+    char rgba[4];
+    qToLittleEndian<quint32>(stroke.color.rgba(), rgba);
+    out.append(rgba, 4);
+
+    if (stroke.tool == Tool::ObjectEraser) {
+        const QVector<int> erased = strokes.erasedStrokes(index);
+        Varint::write(out, quint64(erased.size()));
+        int previous = 0;
+        for (int id : erased) {
+            Varint::writeSigned(out, id - previous);
+            previous = id;
+        }
+        return;
+    }
+
+    Varint::write(out, quint64(stroke.pointCount));
+    QPoint previous;
+    for (int p = 0; p < stroke.pointCount; ++p) {
+        Varint::writeSigned(out, stroke.points[p].x() - previous.x());
+        Varint::writeSigned(out, stroke.points[p].y() - previous.y());
+        previous = stroke.points[p];
+    }
+
+    if (stroke.tool == Tool::Text) {
+        const QByteArray utf8 = stroke.text.toUtf8();
+        Varint::write(out, quint64(utf8.size()));
+        out.append(utf8);
+    }
+}
+
+bool BoardFile::readEntry(const QByteArray &data, StrokeStore *strokes)
+{
+    Varint::Reader in(reinterpret_cast<const uchar *>(data.constData()), data.size());
+    return parseEntry(in, strokes) && in.remaining() == 0;
+}
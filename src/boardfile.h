@@ -0,0 +1,26 @@
+#ifndef BOARDFILE_H
+#define BOARDFILE_H
+
+#include <QImage>
+#include <QString>
+#include "strokestore.h"
+
+// Versioned binary board format. After a fixed header come the base layer (PNG) and
+// every history entry up to the current position. Numbers are LEB128 varints, signed
+// ones zigzag-encoded, and each point is stored as its delta from the previous one,
+// so a typical freehand sample takes two bytes. Loading maps the file instead of
+// reading it into memory first.
+namespace BoardFile {
+    constexpr char MAGIC[4] = { 'C', 'R', 'B', 'D' };
+    constexpr quint16 VERSION = 1;
+
+    bool save(const QString &path, const StrokeStore &strokes, const QImage &base);
+    bool load(const QString &path, StrokeStore *strokes, QImage *base);
+
+    // One history entry in the same encoding, for the journal
+    void writeEntry(QByteArray &out, const StrokeStore &strokes, int index);
+    // Appends the entry in `data` to `strokes`
+    bool readEntry(const QByteArray &data, StrokeStore *strokes);
+}
+
+#endif // BOARDFILE_H
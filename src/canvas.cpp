@@ -2,14 +2,28 @@
 #include <QEnterEvent>
 #include <QApplication>
 #include <QLineEdit>
+#include <QFile>
+#include <QDebug>
+#include <climits>
+#include "boardfile.h"
+#include "geometry.h"
+#include "trace.h"
 
 Canvas::Canvas(QWidget *parent)
     : QWidget(parent), m_isInitializing(false),
-      drawing(false), mouseInside(false), isMiddleButtonPressed(false), m_ignoreNextRightRelease(false),
+      drawing(false), mouseInside(false), isMiddleButtonPressed(false), m_ignoreNextRightRelease(false), m_clickCommitted(false),
       m_currentTool(Tool::Pen), m_scrollMode(ScrollMode::History),
       m_currentPenWidth(1), m_currentTextSize(16), // Default fallback sizes
+      m_simplifyTolerance(Constants::SIMPLIFY_TOLERANCE),
+      m_liveAntialiasLimit(Constants::LIVE_ANTIALIAS_POINT_LIMIT),
+      m_historyDepth(Constants::HISTORY_DEPTH), m_historyBudgetMb(Constants::HISTORY_BUDGET_MB),
       currentColor(255, 255, 255, 255),
-      m_showIndicator(false), m_textInput(nullptr)
+      m_tiles(Constants::TILE_SIZE),
+      m_history(qint64(Constants::HISTORY_CHECKPOINT_BUDGET_MB) * 1024 * 1024),
+      m_index(Constants::SPATIAL_INDEX_CELL_SIZE),
+      m_glyphs(Constants::GLYPH_CACHE_BUDGET_KB),
+      m_journal(nullptr), m_journalSnapshotPending(false),
+      m_textInput(nullptr), m_showIndicator(false)
 {
     setAttribute(Qt::WA_TranslucentBackground);
     setMouseTracking(true);
@@ -23,6 +37,23 @@ Canvas::Canvas(QWidget *parent)
     m_indicatorTimer->setSingleShot(true);
     m_indicatorTimer->setInterval(Constants::INDICATOR_TIMEOUT_MS);
     connect(m_indicatorTimer, &QTimer::timeout, this, &Canvas::hideModeIndicator);
+
+    m_frames = new FrameScheduler(this);
+
+    m_tileRenderer = new TileRenderer(this);
+    connect(m_tileRenderer, &TileRenderer::tileRendered, this, &Canvas::handleTileRendered);
+    connect(m_tileRenderer, &TileRenderer::finished, this, &Canvas::handleTileBatchFinished);
+
+    m_liveRenderer = new LiveRenderer(this);
+    m_liveRenderer->setAntialiasLimit(m_liveAntialiasLimit);
+    connect(m_liveRenderer, &LiveRenderer::layerChanged, this, [this](const QRect &rect) { m_frames->schedule(this, rect); });
+    m_liveRenderer->start();
+
+    m_overlay = new Overlay(m_frames, this);
+
+    m_hudTimer = new QTimer(this);
+    m_hudTimer->setInterval(Constants::HUD_UPDATE_INTERVAL_MS);
+    connect(m_hudTimer, &QTimer::timeout, this, &Canvas::updateHud);
 }
 
 Canvas::~Canvas() {}
@@ -37,49 +68,231 @@ void Canvas::setInitialTextSize(int size)
     m_currentTextSize = size;
 }
 
+void Canvas::setSimplifyTolerance(qreal tolerance)
+{
+    m_simplifyTolerance = std::max<qreal>(0, tolerance);
+}
+
+void Canvas::setLiveAntialiasLimit(int points)
+{
+    // 0 lifts the limit, as it does for the history options
+    m_liveAntialiasLimit = points > 0 ? points : INT_MAX;
+    m_liveRenderer->setAntialiasLimit(m_liveAntialiasLimit);
+}
+
 void Canvas::setPenColor(const QColor &color)
 {
     currentColor = color;
     if (m_currentTool == Tool::Eraser) {
         setTool(Tool::Pen);
     }
-    update();
+    updateOverlay();
 }
 
 void Canvas::setTool(Tool newTool)
 {
     m_currentTool = newTool;
     showIndicator(toolToString(m_currentTool));
-    update();
 }
 
 void Canvas::undo()
 {
-    if (!paths.isEmpty()) {
-        undonePaths.append(paths.takeLast());
+    TRACE_SCOPE("Canvas::undo");
+    if (!m_strokes.isEmpty()) {
+        const QRegion dirty = entryDamage(m_strokes.count() - 1);
+        m_strokes.undo();
+        journal(Journal::Undo);
+        m_index.removeLast();
+        invalidateTiles(dirty);
         showIndicator("undo");
-        update();
+        m_frames->schedule(this, dirty);
     }
 }
 
 void Canvas::redo()
 {
-    if (!undonePaths.isEmpty()) {
-        paths.append(undonePaths.takeLast());
+    TRACE_SCOPE("Canvas::redo");
+    if (m_strokes.redo()) {
+        journalLastEntry(Journal::Redo);
+        addLastStrokeToCaches();
         showIndicator("redo");
-        update();
     }
 }
 
 void Canvas::clearCanvas()
 {
-    paths.clear();
-    undonePaths.clear();
+    resetBoard();
+    journal(Journal::Clear);
+}
+
+void Canvas::resetBoard()
+{
+    TRACE_SCOPE("Canvas::resetBoard");
+    // Only tiles that something was drawn on need to be emptied
+    if (m_history.hasBase()) {
+        m_tiles.invalidateAll();
+    }
+    for (int i = 0; i < m_index.count(); ++i) {
+        m_tiles.invalidate(m_index.bounds(i));
+    }
+    m_strokes.clear();
+    m_history.clear();
+    m_index.clear();
+    m_pendingBase = QImage();
     if (m_textInput) {
         m_textInput->deleteLater();
         m_textInput = nullptr;
     }
-    update();
+    m_frames->schedule(this, rect());
+}
+
+QImage Canvas::baseLayer() const
+{
+    if (!m_pendingBase.isNull() || !m_history.hasBase()) return m_pendingBase;
+    QVector<QImage> tiles;
+    m_history.restore(0, &tiles);
+    return m_tiles.flatten(tiles);
+}
+
+bool Canvas::saveBoard(const QString &path) const
+{
+    return BoardFile::save(path, m_strokes, baseLayer());
+}
+
+bool Canvas::loadBoard(const QString &path)
+{
+    StrokeStore strokes;
+    QImage base;
+    if (!BoardFile::load(path, &strokes, &base)) return false;
+
+    setBoard(strokes, base);
+    snapshotJournal();
+    return true;
+}
+
+void Canvas::setBoard(const StrokeStore &strokes, const QImage &base)
+{
+    resetBoard();
+    m_strokes = strokes;
+    for (int i = 0; i < m_strokes.count(); ++i) {
+        m_index.append(m_strokes.tool(i) == Tool::ObjectEraser ? QRect() : strokeBounds(m_strokes.at(i)));
+    }
+    // Split into tiles by ensureTiles(), once the grid it belongs on is known
+    m_pendingBase = base;
+    m_tiles.invalidateAll();
+    m_frames->schedule(this, rect());
+}
+
+void Canvas::openJournal(const QString &directory, bool restore)
+{
+    TRACE_SCOPE("Canvas::openJournal");
+    m_journal = new Journal(directory, Constants::JOURNAL_SYNC_INTERVAL_MS, this);
+    if (!m_journal->isLocked()) {
+        qWarning() << "Another instance is journaling to" << directory << "- this board won't be kept";
+        delete m_journal;
+        m_journal = nullptr;
+        return;
+    }
+    if (!restore) {
+        // A fresh generation, so the old board doesn't come back on the next launch either
+        snapshotJournal();
+        m_journal->start();
+        return;
+    }
+    StrokeStore strokes;
+    QImage base;
+    const QString snapshot = m_journal->snapshotPath();
+    bool intact = !QFile::exists(snapshot) || BoardFile::load(snapshot, &strokes, &base);
+
+    const QVector<QByteArray> records = intact ? m_journal->readRecords() : QVector<QByteArray>();
+    for (const QByteArray &record : records) {
+        const QByteArray payload = record.mid(1);
+        switch (static_cast<Journal::Record>(record.at(0))) {
+            case Journal::Commit: intact = BoardFile::readEntry(payload, &strokes); break;
+            case Journal::Undo: strokes.undo(); break;
+            case Journal::Redo: intact = strokes.redo() || BoardFile::readEntry(payload, &strokes); break;
+            case Journal::RemoveLast: if (!strokes.isEmpty()) strokes.removeLast(); break;
+            case Journal::Clear: strokes.clear(); base = QImage(); break;
+            default: intact = false; break;
+        }
+        if (!intact) break;
+    }
+    setBoard(strokes, base);
+
+    if (!intact) {
+        // Start over from what could be recovered rather than append to a damaged log
+        qWarning() << "The journal in" << directory << "is damaged; restored what was readable";
+        snapshotJournal();
+    }
+    m_journal->start();
+}
+
+void Canvas::journal(Journal::Record type, const QByteArray &payload)
+{
+    if (!m_journal) return;
+    m_journal->append(type, payload);
+    if (m_journal->recordsSinceSnapshot() >= Constants::JOURNAL_SNAPSHOT_RECORDS) {
+        snapshotJournal();
+    }
+}
+
+void Canvas::journalLastEntry(Journal::Record type)
+{
+    if (!m_journal) return;
+    QByteArray payload;
+    BoardFile::writeEntry(payload, m_strokes, m_strokes.count() - 1);
+    journal(type, payload);
+}
+
+void Canvas::snapshotJournal()
+{
+    TRACE_SCOPE("Canvas::snapshotJournal");
+    if (!m_journal) return;
+    // The erase entry being built isn't final yet
+    if (drawing && m_currentTool == Tool::ObjectEraser) {
+        m_journalSnapshotPending = true;
+        return;
+    }
+    m_journalSnapshotPending = false;
+    m_journal->snapshot(m_strokes, baseLayer());
+}
+
+Canvas::Metrics Canvas::metrics() const
+{
+    return {
+        m_frames->stats(),
+        m_strokes.count(),
+        m_strokes.redoCount(),
+        m_strokes.totalPoints(),
+        m_strokes.storedPoints(),
+        m_strokes.memoryUsage() + m_history.memoryUsage(),
+        m_tiles.memoryUsage() + m_glyphs.memoryUsage()
+    };
+}
+
+void Canvas::toggleHud()
+{
+    if (m_hudTimer->isActive()) {
+        m_hudTimer->stop();
+        m_overlay->setHud({});
+    } else {
+        m_hudTimer->start();
+        updateHud();
+    }
+}
+
+void Canvas::updateHud()
+{
+    const Metrics m = metrics();
+    const FrameScheduler::Stats &f = m.frames;
+    m_overlay->setHud({
+        QString("frame   %1 ms (%2 ms slot), %3 dropped").arg(f.frameMs, 0, 'f', 1).arg(f.intervalMs, 0, 'f', 1).arg(f.droppedFrames),
+        QString("paint   %1 / %2 / %3 ms").arg(f.lastPaintMs, 0, 'f', 2).arg(f.averagePaintMs, 0, 'f', 2).arg(f.worstPaintMs, 0, 'f', 2),
+        QString("latency %1 / %2 / %3 ms").arg(f.lastLatencyMs, 0, 'f', 1).arg(f.averageLatencyMs, 0, 'f', 1).arg(f.worstLatencyMs, 0, 'f', 1),
+        QString("entries %1 (+%2 redo)").arg(m.entries).arg(m.redoEntries),
+        QString("points  %1 (%2 stored)").arg(m.points).arg(m.storedPoints),
+        QString("memory  %1 MB history, %2 MB caches").arg(m.historyBytes / 1048576.0, 0, 'f', 1).arg(m.cacheBytes / 1048576.0, 0, 'f', 1)
+    });
 }
 
 void Canvas::handleTextEditingFinished()
@@ -106,12 +319,18 @@ void Canvas::handleTextEditingFinished()
         // Calculate the top-left position to make the text's center align with centerPos
         QPoint topLeftPos = centerPos - textRect.center();
 
-        undonePaths.clear();
-        paths.append({ {topLeftPos}, currentColor, 0, Tool::Text, text, m_currentTextSize });
-        update();
+        discardRedoHistory();
+        commitStroke({ &topLeftPos, 1, currentColor, 0, Tool::Text, text, m_currentTextSize });
     }
 }
 
+void Canvas::discardRedoHistory()
+{
+    // Checkpoints past the current position belong to the branch being thrown away
+    m_strokes.discardRedo();
+    m_history.truncate(m_strokes.count());
+}
+
 void Canvas::onRightClickTimeout()
 {
     emit rightButtonClicked();
@@ -120,7 +339,7 @@ void Canvas::onRightClickTimeout()
 void Canvas::hideModeIndicator()
 {
     m_showIndicator = false;
-    update();
+    updateOverlay();
 }
 
 void Canvas::enterEvent(QEnterEvent *event)
@@ -129,7 +348,7 @@ void Canvas::enterEvent(QEnterEvent *event)
     mouseInside = true;
     cursorPos = event->position().toPoint();
     setCursor(Qt::BlankCursor);
-    update();
+    updateOverlay();
 }
 
 void Canvas::leaveEvent(QEvent *event)
@@ -137,12 +356,21 @@ void Canvas::leaveEvent(QEvent *event)
     Q_UNUSED(event);
     mouseInside = false;
     unsetCursor();
-    update();
+    updateOverlay();
+}
+
+void Canvas::hideEvent(QHideEvent *event)
+{
+    QWidget::hideEvent(event);
+    // Hidden mid-drag, say by the two-button close chord, the release never arrives
+    cancelStroke();
 }
 
 void Canvas::mousePressEvent(QMouseEvent *event)
 {
+    TRACE_SCOPE("Canvas::mousePressEvent");
     if (event->button() == Qt::LeftButton) {
+        m_clickCommitted = false;
         // If an input box already exists, finalize it before doing anything else.
         if (m_textInput) {
             handleTextEditingFinished();
@@ -169,16 +397,28 @@ void Canvas::mousePressEvent(QMouseEvent *event)
             m_textInput->move(m_textClickPos);
             m_textInput->show();
             m_textInput->setFocus();
+        } else if (m_currentTool == Tool::ObjectEraser) {
+            drawing = true;
+            m_frames->markInput();
+            discardRedoHistory();
+            // Everything this drag removes becomes one undo step
+            m_strokes.appendErase();
+            m_index.append(QRect());
+            currentPath = { event->position().toPoint() };
+            eraseStrokesAlong(currentPath.first(), currentPath.first());
         } else {
             drawing = true;
-            undonePaths.clear();
+            m_frames->markInput();
+            discardRedoHistory();
             currentPath.clear();
             currentPath.append(event->position().toPoint());
             // For shape tools, add a second point to be modified during mouse move.
             if (m_currentTool == Tool::Line || m_currentTool == Tool::Arrow || m_currentTool == Tool::Rectangle || m_currentTool == Tool::Circle) {
                 currentPath.append(event->position().toPoint());
+                m_frames->schedule(this, strokeBounds(liveStroke()));
+            } else {
+                m_liveRenderer->beginStroke(currentPath.first(), currentColor, m_currentPenWidth, m_currentTool);
             }
-            update();
         }
     } else if (event->button() == Qt::MiddleButton) {
         isMiddleButtonPressed = true;
@@ -189,36 +429,69 @@ void Canvas::mousePressEvent(QMouseEvent *event)
 
 void Canvas::mouseMoveEvent(QMouseEvent *event)
 {
+    TRACE_SCOPE("Canvas::mouseMoveEvent");
+    QRegion dirty;
     cursorPos = event->position().toPoint();
     if (drawing) {
+        m_frames->markInput();
         if (m_currentTool == Tool::Pen || m_currentTool == Tool::Eraser) {
-            currentPath.append(event->position().toPoint());
+            // High-rate mice report many samples per pixel; skip neighbours of the last kept one.
+            // A tolerance of 0 asks for every distinct point.
+            const qreal thinning = m_simplifyTolerance > 0 ? Constants::LIVE_THINNING_DISTANCE : 0;
+            const QPoint delta = cursorPos - currentPath.last();
+            if (QPoint::dotProduct(delta, delta) > thinning * thinning) {
+                // The render thread draws the new segment and reports its damage
+                currentPath.append(cursorPos);
+                m_liveRenderer->addPoint(cursorPos);
+            }
+        } else if (m_currentTool == Tool::ObjectEraser) {
+            // Test the whole sweep so fast drags don't skip over thin strokes
+            eraseStrokesAlong(currentPath.first(), cursorPos);
+            currentPath[0] = cursorPos;
         } else {
-            currentPath[1] = event->position().toPoint();
+            // A shape preview moves as a whole, so both its old and new outlines are damaged
+            dirty += strokeBounds(liveStroke());
+            currentPath[1] = cursorPos;
+            dirty += strokeBounds(liveStroke());
         }
     }
-    update();
+    m_frames->schedule(this, dirty);
+    updateOverlay();
 }
 
 void Canvas::mouseReleaseEvent(QMouseEvent *event)
 {
+    TRACE_SCOPE("Canvas::mouseReleaseEvent");
     if (event->button() == Qt::LeftButton) {
         if (drawing) {
             drawing = false;
+            m_frames->markInput();
+            if (m_currentTool == Tool::ObjectEraser) {
+                m_clickCommitted = finishErase();
+                currentPath.clear();
+                return;
+            }
             if (!currentPath.isEmpty()) {
                 // For shape tools, only add the path if it's not a single point click
                 if (m_currentTool >= Tool::Line) {
                     if (currentPath.first() == currentPath.last()) {
+                        m_frames->schedule(this, strokeBounds(liveStroke()));
                         currentPath.clear();
-                        update();
                         return; // Ignore zero-movement clicks
                     }
                 }
-                QColor pathColor = (m_currentTool == Tool::Eraser) ? QColor(0, 0, 0, 0) : currentColor;
-                paths.append({currentPath, pathColor, m_currentPenWidth, m_currentTool});
+                if (m_currentTool == Tool::Pen || m_currentTool == Tool::Eraser) {
+                    // The stroke ends where the button was let go, even if thinning skipped it
+                    if (currentPath.last() != event->position().toPoint()) {
+                        currentPath.append(event->position().toPoint());
+                    }
+                    currentPath = Geometry::simplifyPolyline(currentPath, m_simplifyTolerance);
+                }
+                commitStroke(liveStroke());
+                m_clickCommitted = true;
                 currentPath.clear();
+                m_liveRenderer->endStroke();
             }
-            update();
         }
     } else if (event->button() == Qt::RightButton) {
         if (m_ignoreNextRightRelease) {
@@ -232,8 +505,41 @@ void Canvas::mouseReleaseEvent(QMouseEvent *event)
     }
 }
 
+bool Canvas::finishErase()
+{
+    // A drag that hit nothing leaves no history entry
+    const int last = m_strokes.count() - 1;
+    const bool erased = !m_strokes.erasedStrokes(last).isEmpty();
+    if (!erased) {
+        m_strokes.removeLast();
+        m_index.removeLast();
+    }
+    // History was compacted during the drag, so the old journal's indices no longer apply
+    if (m_journalSnapshotPending) {
+        snapshotJournal();
+    } else if (erased) {
+        journalLastEntry(Journal::Commit);
+    }
+    return erased;
+}
+
+void Canvas::cancelStroke()
+{
+    if (!drawing) return;
+    drawing = false;
+    if (m_currentTool == Tool::ObjectEraser) {
+        // What the drag erased is already on screen, so it stays, as on release
+        finishErase();
+    } else {
+        m_frames->schedule(this, strokeBounds(liveStroke()));
+        m_liveRenderer->endStroke();
+    }
+    currentPath.clear();
+}
+
 void Canvas::mouseDoubleClickEvent(QMouseEvent *event)
 {
+    TRACE_SCOPE("Canvas::mouseDoubleClickEvent");
     if (event->button() == Qt::LeftButton) {
         // A double-click's primary goal is to toggle help, so we must clean up
         // any side effects from the first click of the double-click action.
@@ -244,10 +550,18 @@ void Canvas::mouseDoubleClickEvent(QMouseEvent *event)
             m_textInput = nullptr;
         }
         
-        // If a "dot" was drawn by a non-text tool, remove it.
-        if (!paths.isEmpty() && m_currentTool != Tool::Text) {
-            paths.removeLast();
-            update();
+        // If the first click drew a "dot" or erased something, take it back. Only then: a
+        // click that left nothing must not remove an older, unrelated entry.
+        const int last = m_strokes.count() - 1;
+        if (m_clickCommitted && last >= 0) {
+            m_clickCommitted = false;
+            const QRegion dirty = entryDamage(last);
+            m_strokes.removeLast();
+            journal(Journal::RemoveLast);
+            m_index.removeLast();
+            m_history.truncate(m_strokes.count());
+            invalidateTiles(dirty);
+            m_frames->schedule(this, dirty);
         }
         
         // Now, perform the actual double-click action.
@@ -260,164 +574,435 @@ void Canvas::mouseDoubleClickEvent(QMouseEvent *event)
     }
 }
 
-void Canvas::paintEvent(QPaintEvent *event)
+void Canvas::drawStroke(QPainter &painter, const StrokeView &stroke, const QImage &glyphs)
 {
-    Q_UNUSED(event);
-    QPainter painter(this);
-    painter.setRenderHint(QPainter::Antialiasing, true);
-
-    // Draw all saved paths
-    for (const auto &pathData : paths) {
-        QPen pen(pathData.color, pathData.penWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-        painter.setPen(pen);
-        painter.setBrush(Qt::NoBrush);
-
-        if (pathData.tool == Tool::Eraser) {
-            painter.setCompositionMode(QPainter::CompositionMode_Clear);
-        } else {
-            painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
-        }
-
-        if (pathData.points.size() > 0) {
-            switch (pathData.tool) {
-                case Tool::Pen:
-                case Tool::Eraser:
-                    if (pathData.points.size() > 1)
-                        painter.drawPolyline(pathData.points.constData(), pathData.points.size());
-                    break;
-                case Tool::Line:
-                    if (pathData.points.size() > 1)
-                        painter.drawLine(pathData.points.first(), pathData.points.last());
-                    break;
-                case Tool::Arrow:
-                    if (pathData.points.size() > 1) {
-                        QLineF line(pathData.points.first(), pathData.points.last());
-                        painter.drawLine(line);
-                        // Draw arrowhead
-                        double angle = std::atan2(-line.dy(), line.dx());
-                        qreal arrowSize = pathData.penWidth * 3;
-                        QPointF arrowP1 = line.p2() - QPointF(sin(angle + M_PI / 3) * arrowSize, cos(angle + M_PI / 3) * arrowSize);
-                        QPointF arrowP2 = line.p2() - QPointF(sin(angle + M_PI - M_PI / 3) * arrowSize, cos(angle + M_PI - M_PI / 3) * arrowSize);
-                        painter.drawPolyline(QPolygonF() << arrowP1 << line.p2() << arrowP2);
-                    }
-                    break;
-                case Tool::Rectangle:
-                     if (pathData.points.size() > 1)
-                        painter.drawRect(QRect(pathData.points.first(), pathData.points.last()));
-                    break;
-                case Tool::Circle:
-                     if (pathData.points.size() > 1)
-                        painter.drawEllipse(QRect(pathData.points.first(), pathData.points.last()));
-                    break;
-                case Tool::Text:
-                    {
-                        painter.save();
-                        QFont font = painter.font();
-                        font.setPointSize(pathData.textSize);
-                        painter.setFont(font);
-                        painter.drawText(pathData.points.first(), pathData.text);
-                        painter.restore();
-                    }
-                    break;
-            }
-        }
+    // One zone per tool, to tell which kind of stroke a slow rebuild spent its time on
+    static const char *const zones[Constants::TOOL_COUNT] = {
+        "drawStroke Pen", "drawStroke Eraser", "drawStroke ObjectEraser", "drawStroke Text",
+        "drawStroke Line", "drawStroke Arrow", "drawStroke Rectangle", "drawStroke Circle"
+    };
+    TRACE_SCOPE(zones[static_cast<int>(stroke.tool)]);
+    if (stroke.pen) {
+        painter.setPen(*stroke.pen);
+    } else {
+        painter.setPen(QPen(stroke.color, stroke.penWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
     }
-    
-    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter.setBrush(Qt::NoBrush);
 
-    // Draw the current path being drawn
-    if (drawing && currentPath.size() > 1) {
-        QColor pathColor = (m_currentTool == Tool::Eraser) ? QColor(0, 0, 0, 0) : currentColor;
-        QPen pen(pathColor, m_currentPenWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-        painter.setPen(pen);
-        painter.setBrush(Qt::NoBrush);
-
-        if (m_currentTool == Tool::Eraser) {
-            painter.setCompositionMode(QPainter::CompositionMode_Clear);
-        }
+    if (stroke.tool == Tool::Eraser) {
+        painter.setCompositionMode(QPainter::CompositionMode_Clear);
+    } else {
+        painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    }
 
-        switch (m_currentTool) {
+    if (stroke.pointCount > 0) {
+        const QPoint &first = stroke.points[0];
+        const QPoint &last = stroke.points[stroke.pointCount - 1];
+        switch (stroke.tool) {
             case Tool::Pen:
             case Tool::Eraser:
-                painter.drawPolyline(currentPath.constData(), currentPath.size());
+                if (stroke.pointCount > 1)
+                    painter.drawPolyline(stroke.points, stroke.pointCount);
                 break;
+            case Tool::ObjectEraser:
+                break; // Erase entries have nothing to draw
             case Tool::Line:
-                painter.drawLine(currentPath.first(), currentPath.last());
+                if (stroke.pointCount > 1)
+                    painter.drawLine(first, last);
                 break;
             case Tool::Arrow:
-                {
-                    QLineF line(currentPath.first(), currentPath.last());
-                    painter.drawLine(line);
+                if (stroke.pointCount > 1) {
+                    painter.drawLine(first, last);
                     // Draw arrowhead
-                    double angle = std::atan2(-line.dy(), line.dx());
-                    qreal arrowSize = m_currentPenWidth * 3;
-                    QPointF arrowP1 = line.p2() - QPointF(sin(angle + M_PI / 3) * arrowSize, cos(angle + M_PI / 3) * arrowSize);
-                    QPointF arrowP2 = line.p2() - QPointF(sin(angle + M_PI - M_PI / 3) * arrowSize, cos(angle + M_PI - M_PI / 3) * arrowSize);
-                    painter.drawPolyline(QPolygonF() << arrowP1 << line.p2() << arrowP2);
+                    if (stroke.arrowHead) {
+                        painter.drawPolyline(stroke.arrowHead, 3);
+                    } else {
+                        painter.drawPolyline(Geometry::arrowHead(QLineF(first, last), stroke.penWidth * 3));
+                    }
                 }
                 break;
             case Tool::Rectangle:
-                painter.drawRect(QRect(currentPath.first(), currentPath.last()));
+                 if (stroke.pointCount > 1)
+                    painter.drawRect(QRect(first, last));
                 break;
             case Tool::Circle:
-                painter.drawEllipse(QRect(currentPath.first(), currentPath.last()));
+                 if (stroke.pointCount > 1)
+                    painter.drawEllipse(QRect(first, last));
                 break;
             case Tool::Text:
-                // Text is drawn directly, not interactively
+                if (!glyphs.isNull()) {
+                    GlyphCache::draw(painter, first, glyphs);
+                } else {
+                    painter.save();
+                    QFont font = painter.font();
+                    font.setPointSize(stroke.textSize);
+                    painter.setFont(font);
+                    painter.drawText(first, stroke.text);
+                    painter.restore();
+                }
                 break;
         }
-        
-        painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
     }
 
-    // Draw custom cursor and mode indicator
-    if (mouseInside) {
-        // Draw cursor
-        if (m_currentTool == Tool::Eraser) {
-            painter.setPen(Qt::white);
-            painter.setBrush(Qt::transparent);
-            painter.drawEllipse(cursorPos, m_currentPenWidth / 2, m_currentPenWidth / 2);
-        } else {
-            QPen cursorPen(currentColor);
-            cursorPen.setWidth(1);
-            QBrush cursorBrush(currentColor);
-            painter.setPen(cursorPen);
-            painter.setBrush(cursorBrush);
-            painter.drawEllipse(cursorPos, m_currentPenWidth / 2, m_currentPenWidth / 2);
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+}
+
+void Canvas::ensureTiles()
+{
+    const qreal dpr = devicePixelRatioF();
+    if (!m_tiles.matches(size(), dpr)) {
+        // Keyframes at the old resolution can't be blitted anymore. The base layer is
+        // resampled instead, since the strokes it was made from are gone.
+        if (m_history.hasBase()) {
+            QVector<QImage> base;
+            m_history.restore(0, &base);
+            m_pendingBase = m_tiles.flatten(base);
         }
+        m_history.clear();
+        m_tiles.reset(size(), dpr, logicalDpiX(), logicalDpiY());
+    }
+    if (!m_pendingBase.isNull()) {
+        m_history.setBase(m_tiles.split(m_pendingBase));
+        m_pendingBase = QImage();
+    }
+    m_liveRenderer->resize(size(), dpr);
+}
 
-        // Draw mode indicator text if active
-        if (m_showIndicator) {
-            QString mainText = scrollModeToString();
-            
-            QPoint textPos = cursorPos + QPoint(m_currentPenWidth / 2 + 15, m_currentPenWidth / 2 + 15);
-            
-            // Draw outline
-            painter.setPen(Qt::black);
-            painter.drawText(textPos + QPoint(1, 1), mainText);
-            painter.drawText(textPos + QPoint(-1, -1), mainText);
-            painter.drawText(textPos + QPoint(1, -1), mainText);
-            painter.drawText(textPos + QPoint(-1, 1), mainText);
-            if (!m_indicatorSubText.isEmpty()) {
-                QPoint subTextPos = textPos + QPoint(0, 18);
-                painter.drawText(subTextPos + QPoint(1, 1), m_indicatorSubText);
-                painter.drawText(subTextPos + QPoint(-1, -1), m_indicatorSubText);
-                painter.drawText(subTextPos + QPoint(1, -1), m_indicatorSubText);
-                painter.drawText(subTextPos + QPoint(-1, 1), m_indicatorSubText);
-            }
+void Canvas::rebuildDirtyTiles()
+{
+    TRACE_SCOPE("Canvas::rebuildDirtyTiles");
+    // Tiles invalidated while a batch runs wait for it; stale results are rejected by version
+    if (!m_tiles.hasDirtyTiles() || m_tileRenderer->isRunning()) return;
 
-            // Draw text
-            painter.setPen(Qt::white);
-            painter.drawText(textPos, mainText);
-            if (!m_indicatorSubText.isEmpty()) {
-                painter.drawText(textPos + QPoint(0, 18), m_indicatorSubText);
-            }
+    // Start every tile from the nearest keyframe and replay only the strokes after it
+    QVector<QImage> keyframe;
+    const int base = replayBase();
+    m_history.restore(base, &keyframe);
+    const QVector<int> dirtyTiles = m_tiles.dirtyTiles();
+
+    if (dirtyTiles.size() <= Constants::PARALLEL_TILE_THRESHOLD) {
+        // A typical undo touches a few tiles; handing those to the pool would only add a frame of latency
+        for (int tile : dirtyTiles) {
+            m_tiles.setTile(tile, TileRenderer::render(tileJob(tile, keyframe, base), m_strokes, font()));
+        }
+        checkpointStrokeCache();
+        return;
+    }
+
+    QVector<TileRenderer::Job> jobs;
+    jobs.reserve(dirtyTiles.size());
+    for (int tile : dirtyTiles) {
+        jobs.append(tileJob(tile, keyframe, base));
+    }
+    m_tileRenderer->start(jobs, m_strokes, font());
+}
+
+TileRenderer::Job Canvas::tileJob(int tile, const QVector<QImage> &keyframe, int base)
+{
+    const TileCache::Geometry geometry = m_tiles.geometry(tile);
+    QVector<int> strokes = m_index.query(geometry.rect.toAlignedRect());
+    strokes.erase(std::remove_if(strokes.begin(), strokes.end(), [this, base](int i) {
+        return i < base || m_strokes.isErased(i);
+    }), strokes.end());
+
+    // Text is rasterized here on the GUI thread; workers only blit it
+    QHash<int, QImage> glyphs;
+    for (int i : strokes) {
+        if (m_strokes.tool(i) == Tool::Text) {
+            glyphs.insert(i, textGlyphs(m_strokes.at(i)));
         }
     }
+    return { tile, m_tiles.version(tile), geometry, keyframe.value(tile), strokes, glyphs };
+}
+
+QImage Canvas::textGlyphs(const StrokeView &stroke)
+{
+    TRACE_SCOPE("Canvas::textGlyphs");
+    QFont textFont = font();
+    textFont.setPointSize(stroke.textSize);
+    return m_glyphs.text(stroke.text, textFont, stroke.color, this);
+}
+
+void Canvas::handleTileRendered(int tile, quint64 version, const QImage &image)
+{
+    TRACE_SCOPE("Canvas::handleTileRendered");
+    // The tile changed again after this job was queued; it stays dirty for the next pass
+    if (tile >= m_tiles.tileCount() || m_tiles.version(tile) != version) return;
+
+    m_tiles.setTile(tile, image);
+    m_frames->schedule(this, m_tiles.tileRect(tile).toAlignedRect());
+}
+
+void Canvas::handleTileBatchFinished()
+{
+    checkpointStrokeCache();
+    if (m_tiles.hasDirtyTiles()) {
+        rebuildDirtyTiles();
+    }
+}
+
+void Canvas::appendToStrokeCache(const StrokeView &stroke, const QRect &bounds)
+{
+    TRACE_SCOPE("Canvas::appendToStrokeCache");
+    const QImage glyphs = stroke.tool == Tool::Text ? textGlyphs(stroke) : QImage();
+    for (int tile : m_tiles.tilesIn(bounds)) {
+        // Dirty tiles are rebuilt from the store, this stroke included; bump the version so
+        // a rebuild that is already running without it gets rejected
+        if (m_tiles.isDirty(tile)) {
+            m_tiles.markDirty(tile);
+            continue;
+        }
+
+        QImage &image = m_tiles.tile(tile);
+        if (image.isNull()) {
+            if (stroke.tool == Tool::Eraser) continue; // Nothing to erase
+            image = m_tiles.blankTile(tile);
+        }
+        QPainter painter(&image);
+        painter.translate(-m_tiles.tileRect(tile).topLeft());
+        painter.setRenderHint(QPainter::Antialiasing, true);
+        painter.setFont(font());
+        drawStroke(painter, stroke, glyphs);
+    }
+
+    checkpointStrokeCache();
+}
+
+void Canvas::commitStroke(const StrokeView &stroke)
+{
+    TRACE_SCOPE("Canvas::commitStroke");
+    m_strokes.append(stroke);
+    // Recorded first: adding to the caches may compact history, which snapshots the journal
+    journalLastEntry(Journal::Commit);
+    addLastStrokeToCaches();
+}
+
+void Canvas::addLastStrokeToCaches()
+{
+    const int last = m_strokes.count() - 1;
+    const StrokeView stroke = m_strokes.at(last);
+    if (stroke.tool == Tool::ObjectEraser) {
+        // Taking strokes out of the tiles means rebuilding what they covered
+        m_index.append(QRect());
+        const QRegion dirty = entryDamage(last);
+        invalidateTiles(dirty);
+        m_frames->schedule(this, dirty);
+        return;
+    }
+    m_index.append(strokeBounds(stroke));
+    appendToStrokeCache(stroke, m_index.bounds(last));
+    m_frames->schedule(this, m_index.bounds(last));
+}
+
+void Canvas::eraseStrokesAlong(const QPoint &from, const QPoint &to)
+{
+    TRACE_SCOPE("Canvas::eraseStrokesAlong");
+    const qreal radius = m_currentPenWidth / 2.0;
+    const int pad = int(std::ceil(radius)) + 1;
+    const QLineF sweep(from, to);
+    QRegion dirty;
+    for (int i : m_index.query(QRect(from, to).normalized().adjusted(-pad, -pad, pad, pad))) {
+        if (m_strokes.isErased(i) || !hitsStroke(i, sweep, radius)) continue;
+        m_strokes.eraseStroke(i);
+        m_tiles.invalidate(m_index.bounds(i));
+        // A keyframe taken since this drag started no longer matches its entry
+        m_history.truncate(m_strokes.count() - 1);
+        dirty += m_index.bounds(i);
+    }
+    m_frames->schedule(this, dirty);
+}
+
+bool Canvas::hitsStroke(int index, const QLineF &sweep, qreal radius) const
+{
+    const StrokeView stroke = m_strokes.at(index);
+    if (stroke.pointCount == 0) return false;
+
+    // Anywhere on the painted width of the stroke counts
+    const qreal reach = radius + stroke.penWidth / 2.0;
+    const QPoint ends[] = { stroke.points[0], stroke.points[stroke.pointCount - 1] };
+    switch (stroke.tool) {
+        case Tool::Pen:
+            return Geometry::polylineNear(stroke.points, stroke.pointCount, sweep, reach);
+        case Tool::Line:
+            return Geometry::polylineNear(ends, 2, sweep, reach);
+        case Tool::Arrow:
+            return Geometry::polylineNear(ends, 2, sweep, reach)
+                || (stroke.arrowHead && Geometry::polylineNear(stroke.arrowHead, 3, sweep, reach));
+        case Tool::Rectangle: {
+            const QPolygonF outline(QRectF(QRect(ends[0], ends[1])));
+            return Geometry::polylineNear(outline.constData(), int(outline.size()), sweep, reach);
+        }
+        case Tool::Circle: {
+            QPainterPath path;
+            path.addEllipse(QRectF(QRect(ends[0], ends[1])));
+            const QPolygonF outline = path.toFillPolygon();
+            return Geometry::polylineNear(outline.constData(), int(outline.size()), sweep, reach);
+        }
+        case Tool::Text: {
+            // Text is picked anywhere inside its box, not just on the glyphs
+            const QRectF box = QRectF(m_index.bounds(index)).adjusted(-radius, -radius, radius, radius);
+            const QPolygonF outline(box);
+            return box.contains(sweep.p1()) || box.contains(sweep.p2())
+                || Geometry::polylineNear(outline.constData(), int(outline.size()), sweep, 0);
+        }
+        case Tool::Eraser:
+        case Tool::ObjectEraser:
+            // Eraser strokes are invisible; removing one would bring back what it cleared
+            return false;
+    }
+    return false;
+}
+
+QRegion Canvas::entryDamage(int index) const
+{
+    if (m_strokes.tool(index) != Tool::ObjectEraser) return m_index.bounds(index);
+
+    // An erase entry changes whatever the strokes it removed covered
+    QRegion damage;
+    for (int i : m_strokes.erasedStrokes(index)) {
+        damage += m_index.bounds(i);
+    }
+    return damage;
+}
+
+void Canvas::invalidateTiles(const QRegion &region)
+{
+    for (const QRect &rect : region) {
+        m_tiles.invalidate(rect);
+    }
+}
+
+int Canvas::replayBase() const
+{
+    // A keyframe still shows strokes erased after it was taken, so those can't be replayed onto
+    int base = m_history.nearestCheckpoint(m_strokes.count());
+    while (base > 0 && !m_strokes.canReplayFrom(base)) {
+        base = m_history.nearestCheckpoint(base - 1);
+    }
+    return base;
+}
+
+StrokeView Canvas::liveStroke() const
+{
+    QColor pathColor = (m_currentTool == Tool::Eraser) ? QColor(0, 0, 0, 0) : currentColor;
+    return { currentPath.constData(), int(currentPath.size()), pathColor, m_currentPenWidth, m_currentTool };
+}
+
+void Canvas::checkpointStrokeCache()
+{
+    TRACE_SCOPE("Canvas::checkpointStrokeCache");
+    // A keyframe must be a complete picture of one history position
+    if (m_tiles.hasDirtyTiles()) return;
+
+    const int count = m_strokes.count();
+    const int base = replayBase();
+    if (base == count) return;
+
+    int replayPoints = 0;
+    for (int i = base; i < count; ++i) {
+        replayPoints += m_strokes.pointCount(i);
+    }
+    if (count - base >= Constants::HISTORY_CHECKPOINT_INTERVAL || replayPoints >= Constants::HISTORY_CHECKPOINT_POINTS) {
+        m_history.record(count, m_tiles.tiles());
+        compactHistory();
+    }
+}
+
+void Canvas::compactHistory()
+{
+    TRACE_SCOPE("Canvas::compactHistory");
+    const int count = m_strokes.count();
+    int target = 0;
+    if (m_historyDepth > 0) {
+        target = count - m_historyDepth;
+    }
+    const qint64 budget = qint64(m_historyBudgetMb) * 1024 * 1024;
+    const qint64 usage = m_strokes.memoryUsage();
+    if (m_historyBudgetMb > 0 && usage > budget) {
+        // Over budget: drop the fewest old entries that get back under it, rounded up to
+        // a keyframe, but never the most recent steps
+        int low = 0, high = count;
+        while (low < high) {
+            const int mid = low + (high - low) / 2;
+            if (usage - m_strokes.frontMemoryUsage(mid) <= budget) high = mid; else low = mid + 1;
+        }
+        int cut = m_history.nearestCheckpoint(count - Constants::HISTORY_BUDGET_MIN_DEPTH);
+        while (cut > 0) {
+            const int lower = m_history.nearestCheckpoint(cut - 1);
+            if (lower <= 0 || lower < low) break;
+            cut = lower;
+        }
+        target = std::max(target, cut);
+    }
+    if (target <= 0) return;
+
+    // Only a keyframe can become the base layer, and only one that no later entry
+    // (redo stack included) erased something behind
+    int base = m_history.nearestCheckpoint(target);
+    while (base > 0 && !m_strokes.canDropFront(base)) {
+        base = m_history.nearestCheckpoint(base - 1);
+    }
+    if (base <= 0) return;
+
+    m_strokes.dropFront(base);
+    m_index.dropFront(base);
+    m_history.dropFront(base);
+    // Entry indices shifted, so later records only make sense against a new snapshot
+    snapshotJournal();
+}
+
+void Canvas::setHistoryDepth(int entries)
+{
+    m_historyDepth = std::max(0, entries);
+}
+
+void Canvas::setHistoryBudget(int megabytes)
+{
+    m_historyBudgetMb = std::max(0, megabytes);
+}
+
+void Canvas::paintEvent(QPaintEvent *event)
+{
+    TRACE_SCOPE("Canvas::paintEvent");
+    QElapsedTimer paintTimer;
+    paintTimer.start();
+
+    ensureTiles();
+    rebuildDirtyTiles();
+
+    QPainter painter(this);
+
+    // Blit the committed strokes; the exposed area is already cleared for a translucent widget
+    for (const QRect &exposed : event->region()) {
+        m_tiles.paint(painter, exposed);
+    }
+    // Freehand strokes in progress are already rasterized by the render thread. Only once
+    // every tile is down: a tile spanning two exposed rects is blitted whole for each, and
+    // would wipe live pixels (or an eraser's punch) drawn for the first.
+    if (drawing) {
+        for (const QRect &exposed : event->region()) {
+            m_liveRenderer->paint(painter, exposed);
+        }
+    }
+    // Draw the shape being dragged out; it is redrawn smoothly into the tiles on release
+    if (drawing && m_currentTool >= Tool::Line) {
+        painter.setRenderHint(QPainter::Antialiasing, currentPath.size() <= m_liveAntialiasLimit);
+        drawStroke(painter, liveStroke());
+    }
+
+    painter.end();
+    m_frames->recordPaint(this, paintTimer.nsecsElapsed());
+}
+
+void Canvas::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    m_overlay->setGeometry(rect());
 }
 
 void Canvas::wheelEvent(QWheelEvent *event)
 {
+    TRACE_SCOPE("Canvas::wheelEvent");
     int delta = event->angleDelta().y();
     if (delta == 0) return;
 
@@ -455,21 +1040,19 @@ void Canvas::wheelEvent(QWheelEvent *event)
                 m_currentPenWidth = std::max(1, m_currentPenWidth + (delta > 0 ? -Constants::SIZE_SENSITIVITY : Constants::SIZE_SENSITIVITY));
                 showIndicator(QString("%1px").arg(m_currentPenWidth));
             }
-            update();
             return; 
         case ScrollMode::History:
             (delta > 0) ? undo() : redo();
             return; 
         case ScrollMode::ToolSwitch:
             int currentToolIndex = static_cast<int>(m_currentTool);
-            int nextToolIndex = (currentToolIndex + (delta > 0 ? -1 : 1) + 7) % 7;
+            int nextToolIndex = (currentToolIndex + (delta > 0 ? -1 : 1) + Constants::TOOL_COUNT) % Constants::TOOL_COUNT;
             setTool(static_cast<Tool>(nextToolIndex));
             return;
     }
 
     currentColor.setHsv(h, s, v, a);
     showIndicator();
-    update();
 }
 
 void Canvas::cycleScrollMode()
@@ -488,6 +1071,7 @@ void Canvas::cycleScrollModeBackward()
 
 void Canvas::showIndicator(const QString &subText)
 {
+    TRACE_SCOPE("Canvas::showIndicator");
     if (m_isInitializing) return;
 
     if (m_scrollMode == ScrollMode::Hue || m_scrollMode == ScrollMode::Saturation || m_scrollMode == ScrollMode::Brightness || m_scrollMode == ScrollMode::Opacity) {
@@ -500,7 +1084,42 @@ void Canvas::showIndicator(const QString &subText)
 
     m_showIndicator = true;
     m_indicatorTimer->start(); // Restart the timer
-    update();
+    updateOverlay();
+}
+
+void Canvas::updateOverlay()
+{
+    TRACE_SCOPE("Canvas::updateOverlay");
+    // The overlay only repaints when something it shows actually changed
+    m_overlay->setBrush(mouseInside, cursorPos, m_currentPenWidth, (m_currentTool == Tool::Eraser || m_currentTool == Tool::ObjectEraser) ? QColor() : currentColor);
+    m_overlay->setIndicator(m_showIndicator, scrollModeToString(), m_indicatorSubText);
+}
+
+QRect Canvas::strokeBounds(const StrokeView &stroke) const
+{
+    if (stroke.pointCount == 0) return QRect();
+
+    if (stroke.tool == Tool::Text) {
+        QFont textFont = font();
+        textFont.setPointSize(stroke.textSize);
+        return QFontMetrics(textFont).boundingRect(stroke.text).translated(stroke.points[0]).adjusted(-2, -2, 2, 2);
+    }
+
+    int left = stroke.points[0].x(), right = left;
+    int top = stroke.points[0].y(), bottom = top;
+    for (int i = 1; i < stroke.pointCount; ++i) {
+        left = std::min(left, stroke.points[i].x());
+        right = std::max(right, stroke.points[i].x());
+        top = std::min(top, stroke.points[i].y());
+        bottom = std::max(bottom, stroke.points[i].y());
+    }
+
+    // Half the pen plus the antialiased fringe
+    int pad = stroke.penWidth / 2 + 2;
+    if (stroke.tool == Tool::Arrow) {
+        pad += stroke.penWidth * 3; // The arrowhead reaches past the end point
+    }
+    return QRect(QPoint(left, top), QPoint(right, bottom)).adjusted(-pad, -pad, pad, pad);
 }
 
 QString Canvas::scrollModeToString() const
@@ -522,6 +1141,7 @@ QString Canvas::toolToString(Tool tool) const
     switch (tool) {
         case Tool::Pen:       return "pen";
         case Tool::Eraser:    return "eraser";
+        case Tool::ObjectEraser: return "object-eraser";
         case Tool::Text:      return "text";
         case Tool::Line:      return "line";
         case Tool::Arrow:     return "arrow";
@@ -545,6 +1165,7 @@ Tool Canvas::toolFromString(const QString &s)
 {
     if (s.compare("pen", Qt::CaseInsensitive) == 0) return Tool::Pen;
     if (s.compare("eraser", Qt::CaseInsensitive) == 0) return Tool::Eraser;
+    if (s.compare("object-eraser", Qt::CaseInsensitive) == 0) return Tool::ObjectEraser;
     if (s.compare("text", Qt::CaseInsensitive) == 0) return Tool::Text;
     if (s.compare("line", Qt::CaseInsensitive) == 0) return Tool::Line;
     if (s.compare("arrow", Qt::CaseInsensitive) == 0) return Tool::Arrow;
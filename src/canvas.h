@@ -5,14 +5,31 @@
 #include <QPoint>
 #include <QMouseEvent>
 #include <QPaintEvent>
+#include <QResizeEvent>
 #include <QWheelEvent>
+#include <QHideEvent>
 #include <QPainter>
+#include <QImage>
+#include <QRegion>
+#include <QPainterPath>
+#include <QLineF>
 #include <QVector>
 #include <QColor>
 #include <QLineEdit>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <algorithm> // For std::clamp
 #include <cmath> // For std::atan2, std::cos, std::sin
+#include "framescheduler.h"
+#include "glyphcache.h"
+#include "journal.h"
+#include "liverenderer.h"
+#include "overlay.h"
+#include "rasterhistory.h"
+#include "spatialindex.h"
+#include "strokestore.h"
+#include "tilecache.h"
+#include "tilerenderer.h"
 
 namespace Constants {
     constexpr int INDICATOR_TIMEOUT_MS = 1000;
@@ -21,19 +38,39 @@ namespace Constants {
     constexpr int BRIGHTNESS_SENSITIVITY = 5;
     constexpr int OPACITY_SENSITIVITY = 5;
     constexpr int SIZE_SENSITIVITY = 1;
+    constexpr int TOOL_COUNT = 8;
+    // Keyframe the stroke cache after this many strokes or replayed points, whichever comes first
+    constexpr int HISTORY_CHECKPOINT_INTERVAL = 32;
+    constexpr int HISTORY_CHECKPOINT_POINTS = 20000;
+    constexpr int HISTORY_CHECKPOINT_BUDGET_MB = 256;
+    // Entries kept undoable, and memory for stroke data, before old strokes are baked
+    // into the base layer; 0 disables either limit
+    constexpr int HISTORY_DEPTH = 1000;
+    constexpr int HISTORY_BUDGET_MB = 128;
+    // Steps that stay undoable however far over budget the history is
+    constexpr int HISTORY_BUDGET_MIN_DEPTH = 2 * HISTORY_CHECKPOINT_INTERVAL;
+    constexpr int SPATIAL_INDEX_CELL_SIZE = 128;
+    constexpr int TILE_SIZE = 256; // Device pixels
+    // Rebuilds touching more tiles than this go to the thread pool instead of the paint
+    constexpr int PARALLEL_TILE_THRESHOLD = 4;
+    // Max deviation in pixels when thinning freehand input; 0 keeps every distinct point
+    constexpr double SIMPLIFY_TOLERANCE = 0.75;
+    // While drawing, samples closer than this to the last kept one are skipped. Input is in
+    // whole pixels, so anything under 1 would only ever drop exact repeats.
+    constexpr double LIVE_THINNING_DISTANCE = 1.5;
+    // Live previews past this many points are drawn aliased; committing redraws them smoothly.
+    // 0 means no limit
+    constexpr int LIVE_ANTIALIAS_POINT_LIMIT = 4000;
+    // Rasterized text kept around for text strokes and indicator labels, each
+    constexpr int GLYPH_CACHE_BUDGET_KB = 16 * 1024;
+    // Journal writes reach the disk at most this late; replay starts from a fresh
+    // snapshot once this many records have piled up
+    constexpr int JOURNAL_SYNC_INTERVAL_MS = 100;
+    constexpr int JOURNAL_SNAPSHOT_RECORDS = 1000;
+    constexpr int HUD_UPDATE_INTERVAL_MS = 500;
+    constexpr int HUD_PADDING = 8;
 }
 
-// Define Tool enum accessible by other classes
-enum class Tool {
-    Pen,
-    Eraser,
-    Text,
-    Line,
-    Arrow,
-    Rectangle,
-    Circle
-};
-
 // Define the modes for the scroll wheel in the desired order
 enum class ScrollMode {
     History,
@@ -45,16 +82,6 @@ enum class ScrollMode {
     ToolSwitch
 };
 
-// Struct to hold both the points of a path, its color, its width, and the tool used
-struct PathData {
-    QVector<QPoint> points;
-    QColor color;
-    int penWidth;
-    Tool tool;
-    QString text;
-    int textSize; // For text tool
-};
-
 class Canvas : public QWidget
 {
     Q_OBJECT
@@ -74,6 +101,21 @@ public: // Add getters for state saving
     int getPenWidth() const { return m_currentPenWidth; }
     int getTextSize() const { return m_currentTextSize; }
     QColor getColor() const { return currentColor; }
+    int getHistoryDepth() const { return m_historyDepth; }
+    int getHistoryBudget() const { return m_historyBudgetMb; }
+    FrameScheduler *frames() const { return m_frames; }
+
+    // What the HUD and --metrics report
+    struct Metrics {
+        FrameScheduler::Stats frames;
+        int entries;
+        int redoEntries;
+        int points;
+        int storedPoints;  // Including the redo stack
+        qint64 historyBytes; // Stroke data and raster keyframes
+        qint64 cacheBytes;   // Tiles and rasterized text; tiles shared with a keyframe count twice
+    };
+    Metrics metrics() const;
 
     // String conversion helpers for settings
     QString toolToString(Tool tool) const;
@@ -81,17 +123,33 @@ public: // Add getters for state saving
     static Tool toolFromString(const QString &s);
     static ScrollMode scrollModeFromString(const QString &s);
 
+    // Draws a stroke the same way on screen, into tiles and on worker threads.
+    // Text strokes blit their glyphs when they have been rasterized already.
+    static void drawStroke(QPainter &painter, const StrokeView &stroke, const QImage &glyphs = QImage());
+
+    // Whole boards, in the BoardFile format
+    bool saveBoard(const QString &path) const;
+    bool loadBoard(const QString &path);
+    // Restores the board from the journal in `directory` and keeps recording into it;
+    // without `restore`, the journal starts over from an empty board
+    void openJournal(const QString &directory, bool restore = true);
+
 public slots:
     void beginInitialization() { m_isInitializing = true; }
     void endInitialization() { m_isInitializing = false; }
     void setScrollMode(ScrollMode mode) { m_scrollMode = mode; }
     void setInitialPenWidth(int width);
     void setInitialTextSize(int size);
+    void setSimplifyTolerance(qreal tolerance);
+    void setLiveAntialiasLimit(int points);
+    void setHistoryDepth(int entries);
+    void setHistoryBudget(int megabytes);
     void setPenColor(const QColor &color);
     void setTool(Tool newTool);
     void undo();
     void redo();
     void clearCanvas();
+    void toggleHud();
 
 protected:
     void mousePressEvent(QMouseEvent *event) override;
@@ -99,35 +157,88 @@ protected:
     void mouseReleaseEvent(QMouseEvent *event) override;
     void mouseDoubleClickEvent(QMouseEvent *event) override;
     void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
     void wheelEvent(QWheelEvent *event) override;
     void enterEvent(QEnterEvent *event) override;
     void leaveEvent(QEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
     bool eventFilter(QObject *watched, QEvent *event) override;
 
 private slots:
     void handleTextEditingFinished();
     void onRightClickTimeout();
     void hideModeIndicator();
+    void updateHud();
+    void handleTileRendered(int tile, quint64 version, const QImage &image);
+    void handleTileBatchFinished();
 
 private:
     void cycleScrollMode();
     void cycleScrollModeBackward();
     void showIndicator(const QString &subText = "");
+    void ensureTiles();
+    void rebuildDirtyTiles();
+    TileRenderer::Job tileJob(int tile, const QVector<QImage> &keyframe, int base);
+    QImage textGlyphs(const StrokeView &stroke);
+    void appendToStrokeCache(const StrokeView &stroke, const QRect &bounds);
+    void checkpointStrokeCache();
+    void compactHistory();
+    void commitStroke(const StrokeView &stroke);
+    // Ends an object-erase drag; returns whether it erased anything
+    bool finishErase();
+    void cancelStroke();
+    void addLastStrokeToCaches();
+    void discardRedoHistory();
+    void eraseStrokesAlong(const QPoint &from, const QPoint &to);
+    bool hitsStroke(int index, const QLineF &sweep, qreal radius) const;
+    QRegion entryDamage(int index) const;
+    void invalidateTiles(const QRegion &region);
+    void resetBoard();
+    void setBoard(const StrokeStore &strokes, const QImage &base);
+    QImage baseLayer() const;
+    void journal(Journal::Record type, const QByteArray &payload = QByteArray());
+    void journalLastEntry(Journal::Record type);
+    void snapshotJournal();
+    int replayBase() const;
+    StrokeView liveStroke() const;
+    QRect strokeBounds(const StrokeView &stroke) const;
+    void updateOverlay();
 
     bool m_isInitializing;
     bool drawing;
     bool mouseInside;
     bool isMiddleButtonPressed;
     bool m_ignoreNextRightRelease;
+    // Whether the last left click left a history entry, for a double-click to take back
+    bool m_clickCommitted;
     Tool m_currentTool;
     ScrollMode m_scrollMode;
     int m_currentPenWidth;
     int m_currentTextSize;
+    qreal m_simplifyTolerance;
+    int m_liveAntialiasLimit;
+    int m_historyDepth;
+    int m_historyBudgetMb;
     QPoint cursorPos;
     QColor currentColor;
     QVector<QPoint> currentPath;
-    QVector<PathData> paths;
-    QVector<PathData> undonePaths;
+    StrokeStore m_strokes;
+
+    // Committed strokes rasterized once at device resolution; only history changes touch it
+    TileCache m_tiles;
+    TileRenderer *m_tileRenderer;
+    RasterHistory m_history;
+    // Bounds of every stroke on the canvas, for culling and hit-testing
+    SpatialIndex m_index;
+    GlyphCache m_glyphs;
+    // Base layer waiting for a tile grid: loaded from a board, or carried across a resize
+    QImage m_pendingBase;
+    // Crash-safe record of history operations; null when the session isn't saved
+    Journal *m_journal;
+    // A snapshot asked for during an object-erase drag, taken when the drag ends
+    bool m_journalSnapshotPending;
+    // Rasterizes the freehand stroke in progress off the GUI thread
+    LiveRenderer *m_liveRenderer;
     
     QLineEdit *m_textInput;
     QPoint m_textClickPos;
@@ -135,6 +246,12 @@ private:
     QTimer *m_indicatorTimer;
     bool m_showIndicator;
     QString m_indicatorSubText;
+
+    // Every repaint goes through here, paced to the display
+    FrameScheduler *m_frames;
+    // Brush cursor, mode indicator and HUD, repainted independently of the strokes
+    Overlay *m_overlay;
+    QTimer *m_hudTimer;
 };
 
 #endif // CANVAS_H
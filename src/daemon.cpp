@@ -0,0 +1,60 @@
+#include "daemon.h"
+#include <QLocalSocket>
+#include <QDebug>
+
+Daemon::Daemon(QObject *parent)
+    : QObject(parent), m_server(new QLocalServer(this))
+{
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(m_server, &QLocalServer::newConnection, this, [this] {
+        while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+            connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+            connect(socket, &QLocalSocket::readyRead, this, [this, socket] {
+                if (!socket->canReadLine()) return;
+                const QString command = QString::fromUtf8(socket->readLine()).trimmed();
+                const bool known = COMMANDS.contains(command);
+                socket->write(known ? "ok\n" : "unknown command\n");
+                socket->disconnectFromServer();
+                if (known) emit commandReceived(command);
+            });
+        }
+    });
+}
+
+QString Daemon::serverName()
+{
+    // Local server names are shared by all users on some platforms
+    const QString user = qEnvironmentVariable("USER", qEnvironmentVariable("USERNAME"));
+    return QStringLiteral("crystal-board-%1").arg(user);
+}
+
+bool Daemon::listen()
+{
+    if (m_server->listen(serverName())) return true;
+    if (m_server->serverError() != QAbstractSocket::AddressInUseError) {
+        qWarning() << "Cannot listen for commands:" << m_server->errorString();
+        return false;
+    }
+    // Either another instance is resident, or one crashed and left its socket behind
+    QLocalSocket probe;
+    probe.connectToServer(serverName());
+    if (probe.waitForConnected(TIMEOUT_MS)) return false;
+    QLocalServer::removeServer(serverName());
+    return m_server->listen(serverName());
+}
+
+bool Daemon::send(const QString &command, QString *reply)
+{
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    if (!socket.waitForConnected(TIMEOUT_MS)) return false;
+
+    socket.write(command.toUtf8() + '\n');
+    if (!socket.waitForBytesWritten(TIMEOUT_MS)) return false;
+    while (!socket.canReadLine()) {
+        if (!socket.waitForReadyRead(TIMEOUT_MS)) return false;
+    }
+    const QString answer = QString::fromUtf8(socket.readLine()).trimmed();
+    if (reply) *reply = answer;
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QLocalServer>
+
+// Single-instance control. A resident instance listens on a per-user local socket;
+// later invocations send it a one-line command and exit, so showing the board costs
+// a window map instead of a full startup, and the drawing stays in memory.
+class Daemon : public QObject
+{
+    Q_OBJECT
+
+public:
+    static inline const QStringList COMMANDS = { "show", "hide", "toggle", "clear", "quit" };
+    static constexpr int TIMEOUT_MS = 1000;
+
+    explicit Daemon(QObject *parent = nullptr);
+
+    // Becomes the resident instance; false if another one already is
+    bool listen();
+    // From another process: true if a resident instance answered. `reply` is "ok"
+    // or why the command was refused.
+    static bool send(const QString &command, QString *reply = nullptr);
+
+signals:
+    void commandReceived(const QString &command);
+
+private:
+    static QString serverName();
+
+    QLocalServer *m_server;
+};
+
+#endif // DAEMON_H
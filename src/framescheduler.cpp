@@ -0,0 +1,96 @@
+#include "framescheduler.h"
+#include <QScreen>
+#include <algorithm>
+#include <utility>
+#include "trace.h"
+
+FrameScheduler::FrameScheduler(QObject *parent)
+    : QObject(parent), m_lastFlush(0), m_deadline(0), m_intervalNs(1000000000 / 60), m_lastPaint(-1), m_inputSince(-1)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &FrameScheduler::flush);
+    m_clock.start();
+    resetStats();
+}
+
+void FrameScheduler::schedule(QWidget *widget, const QRegion &region)
+{
+    if (region.isEmpty()) return;
+
+    auto it = std::find_if(m_pending.begin(), m_pending.end(), [widget](const Pending &p) { return p.widget == widget; });
+    if (it != m_pending.end()) {
+        it->region += region;
+    } else {
+        m_pending.append({ widget, region });
+    }
+    if (m_timer.isActive()) return;
+
+    // Follow the refresh rate of whichever screen the widget is on now
+    if (const QScreen *screen = widget->screen()) {
+        if (screen->refreshRate() > 0) m_intervalNs = qint64(1e9 / screen->refreshRate());
+    }
+    m_stats.intervalMs = m_intervalNs / 1e6;
+
+    // The first change after idling is drawn right away; later ones wait for the next frame slot
+    const qint64 now = m_clock.nsecsElapsed();
+    m_deadline = std::max(now, m_lastFlush + m_intervalNs);
+    m_timer.start(int((m_deadline - now) / 1000000));
+}
+
+void FrameScheduler::flush()
+{
+    TRACE_SCOPE("FrameScheduler::flush");
+    const qint64 now = m_clock.nsecsElapsed();
+    m_stats.droppedFrames += int((now - m_deadline) / m_intervalNs);
+    m_lastFlush = now;
+
+    const QVector<Pending> pending = std::exchange(m_pending, {});
+    m_flushed.clear();
+    for (const Pending &p : pending) {
+        if (!p.widget) continue;
+        p.widget->update(p.region);
+        m_flushed.insert(p.widget);
+    }
+}
+
+void FrameScheduler::recordPaint(const QWidget *widget, qint64 nsecs)
+{
+    if (!m_flushed.remove(widget)) return;
+    ++m_stats.frames;
+    m_totalPaintNs += nsecs;
+    m_stats.lastPaintMs = nsecs / 1e6;
+    m_stats.averagePaintMs = m_totalPaintNs / 1e6 / m_stats.frames;
+    m_stats.worstPaintMs = std::max(m_stats.worstPaintMs, m_stats.lastPaintMs);
+
+    const qint64 now = m_clock.nsecsElapsed();
+    // A gap of several frame slots is idle time, not a slow frame
+    if (m_lastPaint >= 0 && now - m_lastPaint < 4 * m_intervalNs) {
+        m_stats.frameMs = (now - m_lastPaint) / 1e6;
+    }
+    m_lastPaint = now;
+    qint64 latency = -1;
+    if (m_inputSince >= 0) {
+        latency = now - m_inputSince;
+        ++m_latencySamples;
+        m_totalLatencyNs += latency;
+        m_stats.lastLatencyMs = latency / 1e6;
+        m_stats.averageLatencyMs = m_totalLatencyNs / 1e6 / m_latencySamples;
+        m_stats.worstLatencyMs = std::max(m_stats.worstLatencyMs, m_stats.lastLatencyMs);
+        m_inputSince = -1;
+    }
+    emit painted(latency);
+}
+
+void FrameScheduler::markInput()
+{
+    if (m_inputSince < 0) m_inputSince = m_clock.nsecsElapsed();
+}
+
+void FrameScheduler::resetStats()
+{
+    m_totalPaintNs = 0;
+    m_totalLatencyNs = 0;
+    m_latencySamples = 0;
+    m_stats = { 0, 0, m_intervalNs / 1e6, 0, 0, 0, 0, 0, 0, 0 };
+}
@@ -0,0 +1,78 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QRegion>
+#include <QSet>
+#include <QTimer>
+#include <QVector>
+#include <QWidget>
+
+// Paces repaints to the display's refresh rate. Widgets hand their damage here
+// instead of calling update(); everything that changed since the last frame is
+// flushed as one repaint at the next frame boundary. When painting falls behind,
+// frames are skipped rather than queued, and the clock sleeps while nothing is damaged.
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats {
+        int frames;
+        int droppedFrames; // Frame slots that passed with damage pending
+        qreal intervalMs;
+        qreal lastPaintMs;
+        qreal averagePaintMs;
+        qreal worstPaintMs;
+        qreal frameMs;           // Between the last two paints, if they were consecutive frames
+        qreal lastLatencyMs;     // From the oldest input not yet on screen to the paint showing it
+        qreal averageLatencyMs;
+        qreal worstLatencyMs;
+    };
+
+    explicit FrameScheduler(QObject *parent = nullptr);
+
+    void schedule(QWidget *widget, const QRegion &region);
+    // Reported by the canvas with the time its paintEvent took. Only paints of damage
+    // flushed from here count as frames: a translucent child repainting, or an expose,
+    // also repaints the widget, but shows nothing new and must not close the latency window.
+    void recordPaint(const QWidget *widget, qint64 nsecs);
+    // Called on input that changes what the canvas shows, for input-to-present latency
+    void markInput();
+
+    const Stats &stats() const { return m_stats; }
+    void resetStats();
+
+signals:
+    // Emitted after each recorded paint, as its pixels go out to the screen, with the
+    // input-to-present latency it completed, or -1 if no input was waiting on it
+    void painted(qint64 latencyNs);
+
+private slots:
+    void flush();
+
+private:
+    struct Pending {
+        QPointer<QWidget> widget;
+        QRegion region;
+    };
+
+    QVector<Pending> m_pending;
+    // Widgets updated by the last flush whose paint hasn't been recorded yet
+    QSet<const QWidget *> m_flushed;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_lastFlush;    // ns on m_clock
+    qint64 m_deadline;     // When the pending frame was due
+    qint64 m_intervalNs;
+    qint64 m_totalPaintNs;
+    qint64 m_lastPaint;    // ns on m_clock, or -1
+    qint64 m_inputSince;   // ns on m_clock, or -1 when every input is on screen
+    qint64 m_totalLatencyNs;
+    int m_latencySamples;
+    Stats m_stats;
+};
+
+#endif // FRAMESCHEDULER_H
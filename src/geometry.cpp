@@ -0,0 +1,100 @@
+#include "geometry.h"
+#include <QPair>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+qreal squaredDistanceToSegment(const QPointF &p, const QPointF &a, const QPointF &b)
+{
+    const QPointF ab = b - a;
+    const qreal lengthSquared = QPointF::dotProduct(ab, ab);
+    qreal t = lengthSquared > 0 ? QPointF::dotProduct(p - a, ab) / lengthSquared : 0.0;
+    t = std::clamp(t, 0.0, 1.0);
+    const QPointF d = p - (a + ab * t);
+    return QPointF::dotProduct(d, d);
+}
+
+qreal cross(const QPointF &o, const QPointF &a, const QPointF &b)
+{
+    return (a.x() - o.x()) * (b.y() - o.y()) - (a.y() - o.y()) * (b.x() - o.x());
+}
+
+qreal squaredSegmentDistance(const QPointF &a, const QPointF &b, const QPointF &c, const QPointF &d)
+{
+    // Properly crossing segments touch; otherwise the closest pair involves an endpoint
+    const qreal d1 = cross(c, d, a), d2 = cross(c, d, b);
+    const qreal d3 = cross(a, b, c), d4 = cross(a, b, d);
+    if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))) return 0;
+    return std::min({ squaredDistanceToSegment(a, c, d), squaredDistanceToSegment(b, c, d),
+                      squaredDistanceToSegment(c, a, b), squaredDistanceToSegment(d, a, b) });
+}
+
+template <typename Point>
+bool polylineNearImpl(const Point *points, int count, const QLineF &segment, qreal distance)
+{
+    if (count == 0) return false;
+    const qreal limit = distance * distance;
+    if (count == 1) return squaredDistanceToSegment(points[0], segment.p1(), segment.p2()) <= limit;
+    for (int i = 0; i + 1 < count; ++i) {
+        if (squaredSegmentDistance(points[i], points[i + 1], segment.p1(), segment.p2()) <= limit) return true;
+    }
+    return false;
+}
+
+} // namespace
+
+QVector<QPoint> Geometry::simplifyPolyline(const QVector<QPoint> &points, qreal tolerance)
+{
+    if (tolerance <= 0 || points.size() < 3) return points;
+
+    const qreal toleranceSquared = tolerance * tolerance;
+    QVector<bool> keep(points.size(), false);
+    keep.first() = true;
+    keep.last() = true;
+
+    // Iterative, since freehand strokes can be long enough to blow a recursive stack
+    QVector<QPair<int, int>> ranges;
+    ranges.append({ 0, int(points.size()) - 1 });
+    while (!ranges.isEmpty()) {
+        const auto [first, last] = ranges.takeLast();
+        qreal maxDistance = 0;
+        int farthest = -1;
+        for (int i = first + 1; i < last; ++i) {
+            const qreal distance = squaredDistanceToSegment(points[i], points[first], points[last]);
+            if (distance > maxDistance) {
+                maxDistance = distance;
+                farthest = i;
+            }
+        }
+        if (farthest >= 0 && maxDistance > toleranceSquared) {
+            keep[farthest] = true;
+            ranges.append({ first, farthest });
+            ranges.append({ farthest, last });
+        }
+    }
+
+    QVector<QPoint> simplified;
+    for (int i = 0; i < points.size(); ++i) {
+        if (keep[i]) simplified.append(points[i]);
+    }
+    return simplified;
+}
+
+QPolygonF Geometry::arrowHead(const QLineF &line, qreal size)
+{
+    const double angle = std::atan2(-line.dy(), line.dx());
+    const QPointF p1 = line.p2() - QPointF(std::sin(angle + M_PI / 3) * size, std::cos(angle + M_PI / 3) * size);
+    const QPointF p2 = line.p2() - QPointF(std::sin(angle + M_PI - M_PI / 3) * size, std::cos(angle + M_PI - M_PI / 3) * size);
+    return QPolygonF() << p1 << line.p2() << p2;
+}
+
+bool Geometry::polylineNear(const QPoint *points, int count, const QLineF &segment, qreal distance)
+{
+    return polylineNearImpl(points, count, segment, distance);
+}
+
+bool Geometry::polylineNear(const QPointF *points, int count, const QLineF &segment, qreal distance)
+{
+    return polylineNearImpl(points, count, segment, distance);
+}
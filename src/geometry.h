@@ -0,0 +1,19 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <QPoint>
+#include <QVector>
+#include <QPolygonF>
+#include <QLineF>
+
+namespace Geometry {
+    // Ramer-Douglas-Peucker: drops points while keeping the polyline within `tolerance` pixels
+    QVector<QPoint> simplifyPolyline(const QVector<QPoint> &points, qreal tolerance);
+    // The two barbs and tip of an arrowhead at the end of `line`, as a polyline
+    QPolygonF arrowHead(const QLineF &line, qreal size);
+    // Whether any part of the polyline comes within `distance` of `segment`
+    bool polylineNear(const QPoint *points, int count, const QLineF &segment, qreal distance);
+    bool polylineNear(const QPointF *points, int count, const QLineF &segment, qreal distance);
+}
+
+#endif // GEOMETRY_H
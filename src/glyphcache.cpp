@@ -0,0 +1,54 @@
+#include "glyphcache.h"
+#include <QFontMetricsF>
+#include "trace.h"
+
+GlyphCache::GlyphCache(int budgetKb)
+    : m_cache(budgetKb)
+{
+}
+
+QImage GlyphCache::text(const QString &text, const QFont &font, const QColor &color, const QPaintDevice *device,
+                        const QColor &outline)
+{
+    const qreal dpr = device->devicePixelRatioF();
+    const QString key = QStringLiteral("%1|%2|%3|%4|%5|%6").arg(font.key())
+                            .arg(color.rgba()).arg(outline.isValid() ? outline.rgba() : 0)
+                            .arg(dpr).arg(device->logicalDpiY()).arg(text);
+    if (const QImage *cached = m_cache.object(key)) return *cached;
+    TRACE_SCOPE("GlyphCache::rasterize");
+
+    // Outline copies reach a pixel past the glyphs, antialiasing one more
+    const int pad = outline.isValid() ? 2 : 1;
+    const QRectF bounds = QFontMetricsF(font, device).boundingRect(text).adjusted(-pad, -pad, pad, pad);
+    const QRect deviceRect = QRectF(bounds.topLeft() * dpr, bounds.size() * dpr).toAlignedRect();
+
+    QImage image(deviceRect.size(), QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(dpr);
+    // Match the device's DPI so point sizes map to the same pixel sizes
+    image.setDotsPerMeterX(qRound(device->logicalDpiX() / 0.0254));
+    image.setDotsPerMeterY(qRound(device->logicalDpiY() / 0.0254));
+    image.setOffset(deviceRect.topLeft());
+    image.fill(Qt::transparent);
+    {
+        QPainter painter(&image);
+        painter.setFont(font);
+        const QPointF origin = -QPointF(deviceRect.topLeft()) / dpr;
+        if (outline.isValid()) {
+            painter.setPen(outline);
+            painter.drawText(origin + QPointF(1, 1), text);
+            painter.drawText(origin + QPointF(-1, -1), text);
+            painter.drawText(origin + QPointF(1, -1), text);
+            painter.drawText(origin + QPointF(-1, 1), text);
+        }
+        painter.setPen(color);
+        painter.drawText(origin, text);
+    }
+
+    m_cache.insert(key, new QImage(image), std::max<qsizetype>(1, image.sizeInBytes() / 1024));
+    return image;
+}
+
+void GlyphCache::draw(QPainter &painter, const QPoint &origin, const QImage &glyphs)
+{
+    painter.drawImage(QPointF(origin) + QPointF(glyphs.offset()) / glyphs.devicePixelRatio(), glyphs);
+}
@@ -0,0 +1,34 @@
+#ifndef GLYPHCACHE_H
+#define GLYPHCACHE_H
+
+#include <QCache>
+#include <QColor>
+#include <QFont>
+#include <QImage>
+#include <QPainter>
+#include <QString>
+
+// Text rasterized once per string, font, color and device, then blitted. Shaping
+// and drawing a string costs far more than copying its pixels, and the results are
+// plain images, so worker threads can draw them too (QStaticText re-lays itself out
+// on every thread it is drawn from).
+class GlyphCache
+{
+public:
+    explicit GlyphCache(int budgetKb);
+
+    // The image's offset() is where its top-left sits relative to the text baseline
+    // origin, in device pixels. A valid outline color adds a 1px outline.
+    QImage text(const QString &text, const QFont &font, const QColor &color, const QPaintDevice *device,
+                const QColor &outline = QColor());
+    void clear() { m_cache.clear(); }
+    qint64 memoryUsage() const { return qint64(m_cache.totalCost()) * 1024; }
+
+    // Draws glyphs from text() as drawText(origin, text) would have
+    static void draw(QPainter &painter, const QPoint &origin, const QImage &glyphs);
+
+private:
+    QCache<QString, QImage> m_cache;
+};
+
+#endif // GLYPHCACHE_H
@@ -0,0 +1,199 @@
+#include "inputtrace.h"
+#include <QApplication>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "varint.h"
+
+TraceRecorder::TraceRecorder(const QString &path, QObject *parent)
+    : QObject(parent), m_file(path), m_lastUsecs(0)
+{
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot record a trace to" << path << m_file.errorString();
+        return;
+    }
+    char header[8] = {};
+    std::memcpy(header, InputTrace::MAGIC, 4);
+    qToLittleEndian<quint16>(InputTrace::VERSION, header + 4);
+    m_file.write(header, sizeof(header));
+    m_clock.start();
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    flush();
+}
+
+void TraceRecorder::watch(QWidget *target)
+{
+    m_targets.append(target);
+    target->installEventFilter(this);
+}
+
+bool TraceRecorder::eventFilter(QObject *watched, QEvent *event)
+{
+    InputTrace::Type type;
+    switch (event->type()) {
+        case QEvent::MouseButtonPress: type = InputTrace::Press; break;
+        case QEvent::MouseButtonRelease: type = InputTrace::Release; break;
+        case QEvent::MouseMove: type = InputTrace::Move; break;
+        case QEvent::MouseButtonDblClick: type = InputTrace::DoubleClick; break;
+        case QEvent::Wheel: type = InputTrace::Wheel; break;
+        default: return false;
+    }
+    if (!m_file.isOpen()) return false;
+
+    const QSinglePointEvent *pointer = static_cast<QSinglePointEvent *>(event);
+    const QPoint position = pointer->position().toPoint();
+    const qint64 usecs = m_clock.nsecsElapsed() / 1000;
+    Varint::write(m_buffer, quint64(usecs - m_lastUsecs));
+    m_buffer.append(char(type));
+    Varint::write(m_buffer, quint64(m_targets.indexOf(watched)));
+    Varint::writeSigned(m_buffer, position.x() - m_lastPosition.x());
+    Varint::writeSigned(m_buffer, position.y() - m_lastPosition.y());
+    Varint::write(m_buffer, quint64(pointer->button()));
+    Varint::write(m_buffer, quint64(pointer->buttons().toInt()));
+    Varint::write(m_buffer, quint64(pointer->modifiers().toInt()));
+    if (type == InputTrace::Wheel) {
+        const QPoint angle = static_cast<QWheelEvent *>(event)->angleDelta();
+        Varint::writeSigned(m_buffer, angle.x());
+        Varint::writeSigned(m_buffer, angle.y());
+    }
+    m_lastUsecs = usecs;
+    m_lastPosition = position;
+
+    // A few bytes per event; writing in chunks keeps file I/O out of the input path
+    if (m_buffer.size() >= 16 * 1024) flush();
+    return false;
+}
+
+void TraceRecorder::flush()
+{
+    if (m_buffer.isEmpty() || !m_file.isOpen()) return;
+    m_file.write(m_buffer);
+    m_file.flush();
+    m_buffer.clear();
+}
+
+TracePlayer::TracePlayer(const QString &path, qreal speed, FrameScheduler *frames, QObject *parent)
+    : QObject(parent), m_valid(false), m_speed(std::max<qreal>(0, speed)), m_next(0), m_frames(frames)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &TracePlayer::step);
+    connect(m_frames, &FrameScheduler::painted, this, &TracePlayer::handlePainted);
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot open trace" << path << file.errorString();
+        return;
+    }
+    const QByteArray data = file.readAll();
+    Varint::Reader in(reinterpret_cast<const uchar *>(data.constData()), data.size());
+    const uchar *header;
+    if (!in.readBytes(8, &header) || std::memcmp(header, InputTrace::MAGIC, 4) != 0
+        || qFromLittleEndian<quint16>(header + 4) > InputTrace::VERSION) {
+        qWarning() << path << "is not a trace this version can replay";
+        return;
+    }
+
+    // A trace cut short by a crash replays up to its last whole event
+    qint64 usecs = 0;
+    QPoint position;
+    while (in.remaining() > 0) {
+        quint64 delta, target, button, buttons, modifiers;
+        const uchar *type;
+        qint64 dx, dy;
+        if (!in.readVarint(&delta) || !in.readBytes(1, &type) || *type > InputTrace::Wheel
+            || !in.readVarint(&target) || !in.readSigned(&dx) || !in.readSigned(&dy)
+            || !in.readVarint(&button) || !in.readVarint(&buttons) || !in.readVarint(&modifiers)) break;
+        usecs += qint64(delta);
+        position += QPoint(int(dx), int(dy));
+        InputTrace::Event event { usecs, InputTrace::Type(*type), int(target), position,
+                                  int(button), int(buttons), int(modifiers), QPoint() };
+        if (event.type == InputTrace::Wheel) {
+            qint64 angleX, angleY;
+            if (!in.readSigned(&angleX) || !in.readSigned(&angleY)) break;
+            event.angleDelta = QPoint(int(angleX), int(angleY));
+        }
+        m_events.append(event);
+    }
+    m_valid = true;
+}
+
+void TracePlayer::start()
+{
+    m_next = 0;
+    m_latencies.clear();
+    m_frames->resetStats();
+    m_clock.start();
+    m_timer.start(0);
+}
+
+void TracePlayer::step()
+{
+    // Send everything that is due; at full speed, one event per pass of the event loop
+    // so frames still get painted in between
+    const qint64 now = m_clock.nsecsElapsed() / 1000;
+    while (m_next < m_events.size()) {
+        if (m_speed > 0 && m_events[m_next].usecs / m_speed > now) break;
+        send(m_events[m_next++]);
+        if (m_speed == 0) break;
+    }
+
+    if (m_next < m_events.size()) {
+        const qint64 wait = m_speed > 0 ? qint64(m_events[m_next].usecs / m_speed) - now : 0;
+        m_timer.start(int(std::max<qint64>(0, wait / 1000)));
+        return;
+    }
+    // Give the last events time to reach the screen
+    QTimer::singleShot(100, this, &TracePlayer::report);
+}
+
+void TracePlayer::send(const InputTrace::Event &event)
+{
+    QWidget *target = m_targets.value(event.target);
+    if (!target) return;
+
+    const QPointF position(event.position);
+    const QPointF global = target->mapToGlobal(position);
+    const auto buttons = Qt::MouseButtons::fromInt(event.buttons);
+    const auto modifiers = Qt::KeyboardModifiers::fromInt(event.modifiers);
+    if (event.type == InputTrace::Wheel) {
+        QWheelEvent wheel(position, global, QPoint(), event.angleDelta, buttons, modifiers, Qt::NoScrollPhase, false);
+        QApplication::sendEvent(target, &wheel);
+    } else {
+        static const QEvent::Type types[] = {
+            QEvent::MouseButtonPress, QEvent::MouseButtonRelease, QEvent::MouseMove, QEvent::MouseButtonDblClick
+        };
+        QMouseEvent mouse(types[event.type], position, global, Qt::MouseButton(event.button), buttons, modifiers);
+        QApplication::sendEvent(target, &mouse);
+    }
+}
+
+void TracePlayer::handlePainted(qint64 latencyNs)
+{
+    if (latencyNs >= 0) m_latencies.append(latencyNs);
+}
+
+void TracePlayer::report()
+{
+    std::sort(m_latencies.begin(), m_latencies.end());
+    auto percentile = [this](double p) {
+        if (m_latencies.isEmpty()) return 0.0;
+        const int index = std::clamp(int(std::ceil(p * m_latencies.size())) - 1, 0, int(m_latencies.size()) - 1);
+        return m_latencies[index] / 1e6;
+    };
+    const FrameScheduler::Stats &stats = m_frames->stats();
+    qInfo().noquote() << QStringLiteral("Replayed %1 events in %2 ms").arg(m_events.size()).arg(m_clock.elapsed());
+    qInfo().noquote() << QStringLiteral("Event-to-pixel latency over %1 frames: p50 %2 ms, p90 %3 ms, p99 %4 ms, max %5 ms")
+        .arg(m_latencies.size()).arg(percentile(0.5), 0, 'f', 2).arg(percentile(0.9), 0, 'f', 2)
+        .arg(percentile(0.99), 0, 'f', 2).arg(percentile(1.0), 0, 'f', 2);
+    qInfo().noquote() << QStringLiteral("Paint: %1 frames, average %2 ms, worst %3 ms, %4 dropped")
+        .arg(stats.frames).arg(stats.averagePaintMs, 0, 'f', 2).arg(stats.worstPaintMs, 0, 'f', 2).arg(stats.droppedFrames);
+    emit finished();
+}
@@ -0,0 +1,100 @@
+#ifndef INPUTTRACE_H
+#define INPUTTRACE_H
+
+#include <QObject>
+#include <QWidget>
+#include <QFile>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QTimer>
+#include <QVector>
+#include "framescheduler.h"
+
+// Recording and replay of the mouse input that reaches the canvas and help panel,
+// so a "the board got sluggish" report can be reproduced exactly. A trace is a
+// header followed by one record per event: the time since the previous event in
+// microseconds, type, target widget, position delta, buttons and modifiers, plus
+// the angle delta for wheel events, all as varints (see varint.h).
+namespace InputTrace {
+    constexpr char MAGIC[4] = { 'C', 'R', 'T', 'R' };
+    constexpr quint16 VERSION = 1;
+
+    enum Type : quint8 { Press, Release, Move, DoubleClick, Wheel };
+
+    struct Event {
+        qint64 usecs; // Since the start of the trace
+        Type type;
+        int target;   // Index into the watched widgets
+        QPoint position;
+        int button;
+        int buttons;
+        int modifiers;
+        QPoint angleDelta;
+    };
+}
+
+// Event filter that appends everything it sees to a trace file. Installed after
+// MainWindow's own filter, so it also sees the events that filter swallows.
+class TraceRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    TraceRecorder(const QString &path, QObject *parent = nullptr);
+    ~TraceRecorder();
+
+    void watch(QWidget *target);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    void flush();
+
+    QFile m_file;
+    QByteArray m_buffer;
+    QElapsedTimer m_clock;
+    qint64 m_lastUsecs;
+    QPoint m_lastPosition;
+    QVector<QObject *> m_targets;
+};
+
+// Feeds a trace back to the same widgets, at its original pace scaled by `speed`,
+// or as fast as the event loop allows for a speed of 0. Event-to-pixel latency is
+// what the FrameScheduler measures for the HUD, from the oldest drawing input not
+// yet on screen to the end of the canvas paint that shows it, collected per frame.
+class TracePlayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    TracePlayer(const QString &path, qreal speed, FrameScheduler *frames, QObject *parent = nullptr);
+
+    bool isValid() const { return m_valid; }
+    void watch(QWidget *target) { m_targets.append(target); }
+    void start();
+
+signals:
+    void finished();
+
+private slots:
+    void step();
+    void handlePainted(qint64 latencyNs);
+
+private:
+    void send(const InputTrace::Event &event);
+    void report();
+
+    QVector<InputTrace::Event> m_events;
+    QVector<QPointer<QWidget>> m_targets;
+    bool m_valid;
+    qreal m_speed;
+    int m_next;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    FrameScheduler *m_frames;
+    QVector<qint64> m_latencies;
+};
+
+#endif // INPUTTRACE_H
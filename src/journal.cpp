@@ -0,0 +1,179 @@
+#include "journal.h"
+#include <QDir>
+#include <QDeadlineTimer>
+#include <QMutexLocker>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <utility>
+#include "boardfile.h"
+#include "trace.h"
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+Journal::Journal(const QString &directory, int syncIntervalMs, QObject *parent)
+    : QThread(parent), m_directory(directory), m_lock(QDir(directory).filePath("journal.lock")), m_syncIntervalMs(syncIntervalMs), m_recordsSinceSnapshot(0),
+      m_generation(0), m_validSize(0), m_failed(false), m_quit(false)
+{
+    QDir dir(m_directory);
+    dir.mkpath(".");
+    // A lock left by a crashed instance is taken over; a live one keeps its files
+    if (!m_lock.tryLock(0)) return;
+    // The newest snapshot is complete (it was renamed into place); anything else is stale
+    const QStringList snapshots = dir.entryList({ "snapshot-*.crb" }, QDir::Files);
+    for (const QString &name : snapshots) {
+        m_generation = std::max(m_generation, name.mid(9, name.size() - 13).toInt());
+    }
+    const QStringList files = dir.entryList({ "snapshot-*.crb", "journal-*.log" }, QDir::Files);
+    for (const QString &name : files) {
+        const QString file = dir.filePath(name);
+        if (file != snapshotFile(m_generation) && file != logFile(m_generation)) {
+            QFile::remove(file);
+        }
+    }
+}
+
+Journal::~Journal()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_quit = true;
+        m_wake.wakeOne();
+    }
+    wait();
+}
+
+QString Journal::snapshotFile(int generation) const
+{
+    return QDir(m_directory).filePath(QStringLiteral("snapshot-%1.crb").arg(generation));
+}
+
+QString Journal::logFile(int generation) const
+{
+    return QDir(m_directory).filePath(QStringLiteral("journal-%1.log").arg(generation));
+}
+
+QString Journal::snapshotPath() const
+{
+    return snapshotFile(m_generation);
+}
+
+QVector<QByteArray> Journal::readRecords()
+{
+    QVector<QByteArray> records;
+    QFile file(logFile(m_generation));
+    if (!file.open(QIODevice::ReadOnly)) return records;
+
+    const QByteArray data = file.readAll();
+    qint64 offset = 0;
+    while (data.size() - offset >= 4) {
+        const quint32 size = qFromLittleEndian<quint32>(data.constData() + offset);
+        if (size == 0 || size > quint64(data.size() - offset - 4)) break;
+        records.append(data.mid(offset + 4, size));
+        offset += 4 + size;
+    }
+    if (offset < data.size()) {
+        qWarning() << "Dropping a torn record at the end of" << file.fileName();
+    }
+    // Appending resumes after the last whole record
+    m_validSize = offset;
+    m_recordsSinceSnapshot = int(records.size());
+    return records;
+}
+
+void Journal::append(Record type, const QByteArray &payload)
+{
+    QByteArray record(4, Qt::Uninitialized);
+    qToLittleEndian<quint32>(quint32(payload.size() + 1), record.data());
+    record.append(char(type));
+    record.append(payload);
+    push({ record, StrokeStore(), QImage() });
+    ++m_recordsSinceSnapshot;
+}
+
+void Journal::snapshot(const StrokeStore &strokes, const QImage &base)
+{
+    push({ QByteArray(), strokes, base });
+    m_recordsSinceSnapshot = 0;
+}
+
+void Journal::push(const Task &task)
+{
+    QMutexLocker locker(&m_mutex);
+    m_tasks.append(task);
+    m_wake.wakeOne();
+}
+
+void Journal::run()
+{
+    m_log.setFileName(logFile(m_generation));
+    if (!m_log.open(QIODevice::ReadWrite) || !m_log.resize(m_validSize) || !m_log.seek(m_validSize)) {
+        qWarning() << "Journal disabled, cannot write" << m_log.fileName() << m_log.errorString();
+        m_failed = true;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    forever {
+        while (m_tasks.isEmpty() && !m_quit) {
+            m_wake.wait(&m_mutex);
+        }
+        if (m_tasks.isEmpty()) break;
+        const QVector<Task> tasks = std::exchange(m_tasks, {});
+        locker.unlock();
+
+        for (const Task &task : tasks) {
+            if (m_failed) break;
+            if (task.record.isEmpty()) {
+                m_failed = !writeSnapshot(task);
+            } else if (m_log.write(task.record) != task.record.size()) {
+                qWarning() << "Journal disabled, cannot write" << m_log.fileName() << m_log.errorString();
+                m_failed = true;
+            }
+        }
+        if (!m_failed) sync();
+
+        // One fsync per interval at most: whatever arrives meanwhile goes into the next batch
+        locker.relock();
+        const QDeadlineTimer deadline(m_syncIntervalMs);
+        while (!m_quit && !deadline.hasExpired()) {
+            m_wake.wait(&m_mutex, deadline);
+        }
+    }
+}
+
+bool Journal::writeSnapshot(const Task &task)
+{
+    TRACE_SCOPE("Journal::writeSnapshot");
+    // Records before this task are covered by the snapshot; if it can't be written,
+    // later records would no longer line up with the old generation, so stop instead
+    const int next = m_generation + 1;
+    if (!BoardFile::save(snapshotFile(next), task.strokes, task.base)) {
+        qWarning() << "Journal disabled, cannot write a snapshot to" << m_directory;
+        return false;
+    }
+    sync();
+    m_log.close();
+    m_log.setFileName(logFile(next));
+    if (!m_log.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Journal disabled, cannot write" << m_log.fileName() << m_log.errorString();
+        return false;
+    }
+    QFile::remove(logFile(m_generation));
+    QFile::remove(snapshotFile(m_generation));
+    m_generation = next;
+    return true;
+}
+
+void Journal::sync()
+{
+    TRACE_SCOPE("Journal::sync");
+    m_log.flush();
+#ifdef Q_OS_WIN
+    _commit(m_log.handle());
+#else
+    ::fsync(m_log.handle());
+#endif
+}
@@ -0,0 +1,83 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QFile>
+#include <QLockFile>
+#include <QImage>
+#include <QByteArray>
+#include <QVector>
+#include "strokestore.h"
+
+// Append-only log of history operations, so a crash or a kill loses at most the last
+// sync interval of drawing. Each record is a little-endian length, a type byte and a
+// payload; a record torn by a crash is dropped on replay. Files come in generations:
+// snapshot-N.crb is a BoardFile of the board as journal-N.log starts, and the old
+// generation is only removed once the new snapshot is safely on disk. Writing,
+// fsyncing and encoding snapshots all happen on this thread. One process at a
+// time owns a directory, through a lock file.
+class Journal : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum Record : quint8 {
+        Commit = 1, // Payload: the entry, as BoardFile::writeEntry
+        Undo,
+        Redo,       // Payload: the entry, for when the redo stack predates the snapshot
+        RemoveLast,
+        Clear
+    };
+
+    Journal(const QString &directory, int syncIntervalMs, QObject *parent = nullptr);
+    ~Journal();
+
+    // False if another instance holds the directory; the journal must not be used then
+    bool isLocked() const { return m_lock.isLocked(); }
+
+    // Before start(): the board left by the last session is the snapshot (if it
+    // exists) followed by these records, each starting with its type
+    QString snapshotPath() const;
+    QVector<QByteArray> readRecords();
+
+    void append(Record type, const QByteArray &payload = QByteArray());
+    // Starts a new generation from this state of the board
+    void snapshot(const StrokeStore &strokes, const QImage &base);
+    int recordsSinceSnapshot() const { return m_recordsSinceSnapshot; }
+
+protected:
+    void run() override;
+
+private:
+    struct Task {
+        QByteArray record; // Empty for a snapshot
+        StrokeStore strokes;
+        QImage base;
+    };
+
+    QString snapshotFile(int generation) const;
+    QString logFile(int generation) const;
+    void push(const Task &task);
+    bool writeSnapshot(const Task &task);
+    void sync();
+
+    QString m_directory;
+    QLockFile m_lock;
+    int m_syncIntervalMs;
+    int m_recordsSinceSnapshot; // GUI thread only
+
+    // Writer thread only once started
+    int m_generation;
+    qint64 m_validSize;
+    QFile m_log;
+    bool m_failed;
+
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    QVector<Task> m_tasks;
+    bool m_quit;
+};
+
+#endif // JOURNAL_H
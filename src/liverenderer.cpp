@@ -0,0 +1,149 @@
+#include "liverenderer.h"
+#include <QMutexLocker>
+#include <climits>
+#include "trace.h"
+
+LiveRenderer::LiveRenderer(QObject *parent)
+    : QThread(parent), m_quit(0), m_antialiasLimit(INT_MAX), m_serial(0), m_liveTool(Tool::Pen), m_liveOpacity(1),
+      m_activeSerial(0), m_strokePoints(0), m_hasLastPoint(false), m_clearedSerial(0)
+{
+}
+
+LiveRenderer::~LiveRenderer()
+{
+    m_quit.storeRelease(1);
+    m_wakeup.release();
+    wait();
+}
+
+void LiveRenderer::resize(const QSize &size, qreal dpr)
+{
+    QMutexLocker locker(&m_layerMutex);
+    const QSize pixelSize = size * dpr;
+    if (m_layer.size() == pixelSize && m_layer.devicePixelRatio() == dpr) return;
+
+    m_layer = QImage(pixelSize, QImage::Format_ARGB32_Premultiplied);
+    m_layer.setDevicePixelRatio(dpr);
+    m_layer.fill(Qt::transparent);
+    m_layerBounds = QRect();
+}
+
+void LiveRenderer::beginStroke(const QPoint &point, const QColor &color, int penWidth, Tool tool)
+{
+    m_liveTool = tool;
+    m_liveOpacity = tool == Tool::Eraser ? 1 : color.alphaF();
+    push({ LiveEvent::Begin, ++m_serial, point, color.rgba(), penWidth, tool });
+}
+
+void LiveRenderer::addPoint(const QPoint &point)
+{
+    push({ LiveEvent::Point, m_serial, point, 0, 0, m_liveTool });
+}
+
+void LiveRenderer::endStroke()
+{
+    // Whatever is still queued for this stroke is skipped by serial
+    m_backlog.clear();
+
+    QMutexLocker locker(&m_layerMutex);
+    m_clearedSerial = m_serial;
+    if (!m_layerBounds.isEmpty()) {
+        QPainter painter(&m_layer);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.fillRect(m_layerBounds, Qt::transparent);
+    }
+    m_layerBounds = QRect();
+}
+
+void LiveRenderer::paint(QPainter &painter, const QRect &exposed)
+{
+    TRACE_SCOPE("LiveRenderer::paint");
+    QMutexLocker locker(&m_layerMutex);
+    const QRect area = exposed & m_layerBounds;
+    if (area.isEmpty()) return;
+
+    const qreal dpr = m_layer.devicePixelRatio();
+    painter.save();
+    painter.setOpacity(m_liveOpacity);
+    // The eraser is drawn opaque into the layer and punched out of what's below
+    painter.setCompositionMode(m_liveTool == Tool::Eraser ? QPainter::CompositionMode_DestinationOut
+                                                          : QPainter::CompositionMode_SourceOver);
+    painter.drawImage(area, m_layer, QRectF(QPointF(area.topLeft()) * dpr, QSizeF(area.size()) * dpr));
+    painter.restore();
+}
+
+void LiveRenderer::push(const LiveEvent &event)
+{
+    // Anything that didn't fit before goes first, to keep the stroke in order
+    while (!m_backlog.isEmpty() && m_queue.push(m_backlog.first())) {
+        m_backlog.removeFirst();
+    }
+    if (!m_backlog.isEmpty() || !m_queue.push(event)) {
+        m_backlog.append(event);
+    }
+    m_wakeup.release();
+}
+
+void LiveRenderer::run()
+{
+    forever {
+        m_wakeup.acquire();
+        if (m_quit.loadAcquire()) return;
+        // One pass drains everything queued so far
+        m_wakeup.tryAcquire(m_wakeup.available());
+
+        QRect dirty;
+        {
+            QMutexLocker locker(&m_layerMutex);
+            QPolygon batch;
+            LiveEvent event;
+            while (m_queue.pop(&event)) {
+                if (event.kind == LiveEvent::Begin) {
+                    dirty |= drawBatch(batch);
+                    batch.clear();
+                    // Opacity is applied when the layer is composited
+                    const QColor color = event.tool == Tool::Eraser ? QColor(Qt::black) : QColor::fromRgb(event.color);
+                    m_pen = QPen(color, event.penWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+                    m_activeSerial = event.serial;
+                    m_hasLastPoint = false;
+                    m_strokePoints = 0;
+                }
+                batch << event.point;
+            }
+            dirty |= drawBatch(batch);
+        }
+        if (!dirty.isEmpty()) {
+            emit layerChanged(dirty);
+        }
+    }
+}
+
+QRect LiveRenderer::drawBatch(const QPolygon &points)
+{
+    TRACE_SCOPE("LiveRenderer::drawBatch");
+    // Called with m_layerMutex held
+    if (points.isEmpty() || m_layer.isNull()) return QRect();
+
+    // The stroke was committed and its layer cleared while these points were queued
+    if (m_activeSerial <= m_clearedSerial) return QRect();
+
+    // Continue from where the previous batch ended so the stroke stays connected
+    QPolygon line;
+    if (m_hasLastPoint) line << m_lastPoint;
+    line << points;
+    m_lastPoint = points.last();
+    m_hasLastPoint = true;
+    m_strokePoints += points.size();
+    if (line.size() < 2) return QRect();
+
+    // Long strokes are where antialiasing costs the most; the committed copy is smooth anyway
+    QPainter painter(&m_layer);
+    painter.setRenderHint(QPainter::Antialiasing, m_strokePoints <= m_antialiasLimit.loadRelaxed());
+    painter.setPen(m_pen);
+    painter.drawPolyline(line);
+
+    const int pad = m_pen.width() / 2 + 2;
+    const QRect bounds = line.boundingRect().adjusted(-pad, -pad, pad, pad);
+    m_layerBounds |= bounds;
+    return bounds;
+}
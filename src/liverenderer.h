@@ -0,0 +1,85 @@
+#ifndef LIVERENDERER_H
+#define LIVERENDERER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QSemaphore>
+#include <QImage>
+#include <QPainter>
+#include <QPolygon>
+#include <QPen>
+#include <QVector>
+#include "spscqueue.h"
+#include "strokestore.h"
+
+// Draws the freehand stroke being made into an offscreen layer on its own thread.
+// Input handlers only push points into a lock-free queue, so a slow frame on the
+// GUI thread never delays sampling the next mouse position; the GUI thread just
+// blits the layer. Each batch of points only strokes its own segments, opaque, and
+// the layer is composited at the stroke's alpha, so overlapping segment ends don't
+// build up darker beads on translucent strokes.
+class LiveRenderer : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit LiveRenderer(QObject *parent = nullptr);
+    ~LiveRenderer();
+
+    // GUI thread
+    void resize(const QSize &size, qreal dpr);
+    // Points after the first `points` of a stroke are drawn aliased
+    void setAntialiasLimit(int points) { m_antialiasLimit.storeRelaxed(points); }
+    void beginStroke(const QPoint &point, const QColor &color, int penWidth, Tool tool);
+    void addPoint(const QPoint &point);
+    // Drops the layer's content once the stroke has been committed to the tiles
+    void endStroke();
+    void paint(QPainter &painter, const QRect &exposed);
+
+signals:
+    // Emitted from the render thread with the layer area that changed
+    void layerChanged(const QRect &rect);
+
+protected:
+    void run() override;
+
+private:
+    struct LiveEvent {
+        enum Kind : quint8 { Begin, Point };
+        Kind kind;
+        quint32 serial;
+        QPoint point;
+        QRgb color;   // Begin only
+        int penWidth; // Begin only
+        Tool tool;    // Begin only
+    };
+
+    void push(const LiveEvent &event);
+    QRect drawBatch(const QPolygon &points);
+
+    SpscQueue<LiveEvent, 4096> m_queue;
+    QSemaphore m_wakeup;
+    QAtomicInt m_quit;
+    QAtomicInt m_antialiasLimit;
+
+    // GUI thread only
+    QVector<LiveEvent> m_backlog; // Events that didn't fit into a full queue, in order
+    quint32 m_serial;
+    Tool m_liveTool;
+    qreal m_liveOpacity;
+
+    // Render thread only
+    QPen m_pen;
+    quint32 m_activeSerial;
+    int m_strokePoints;
+    QPoint m_lastPoint;
+    bool m_hasLastPoint;
+
+    // Shared, guarded by m_layerMutex
+    QMutex m_layerMutex;
+    QImage m_layer;
+    QRect m_layerBounds;
+    quint32 m_clearedSerial;
+};
+
+#endif // LIVERENDERER_H
@@ -1,11 +1,18 @@
 #include "mainwindow.h"
+#include "daemon.h"
+#include "trace.h"
 #include <QApplication>
 #include <QCommandLineParser>
 #include <QCommandLineOption>
 #include <QVariantMap>
+#include <QElapsedTimer>
 
 int main(int argc, char *argv[])
 {
+    // Launch-to-first-paint starts here, before Qt itself is up
+    QElapsedTimer launchClock;
+    launchClock.start();
+
     QApplication a(argc, argv);
     QCoreApplication::setOrganizationName("CrystalBoard");
     QCoreApplication::setApplicationName("CrystalBoard");
@@ -20,6 +27,12 @@ int main(int argc, char *argv[])
     QCommandLineOption cleanOption({"c", "clean"}, "Start with a clean canvas, hiding the help panel.");
     parser.addOption(cleanOption);
 
+    QCommandLineOption daemonOption({"d", "daemon"}, "Stay resident in the background, hidden; closing only hides the window.");
+    parser.addOption(daemonOption);
+
+    QCommandLineOption sendOption("send", "Send a command to the resident instance: show, hide, toggle, clear or quit. show and toggle start one if none is running.", "command");
+    parser.addOption(sendOption);
+
     // --- Startup Configuration Options ---
     QCommandLineOption modeOption({"M", "mode"}, "Set the initial scroll mode.", "name", "History");
     parser.addOption(modeOption);
@@ -45,20 +58,88 @@ int main(int argc, char *argv[])
     QCommandLineOption toolOption({"T", "tool"}, "Set the initial tool.", "name", "Pen");
     parser.addOption(toolOption);
 
+    QCommandLineOption simplifyOption("simplify", "Set how far freehand strokes may be simplified (0 keeps every point).", "pixels");
+    parser.addOption(simplifyOption);
+
+    QCommandLineOption liveAntialiasOption("live-aa-limit", "Stop antialiasing the stroke being drawn once it has this many points (0 for no limit); it is smoothed on release.", "points");
+    parser.addOption(liveAntialiasOption);
+
+    QCommandLineOption historyDepthOption("history-depth", "Keep this many steps undoable before older strokes are flattened (0 for no limit).", "steps");
+    parser.addOption(historyDepthOption);
+
+    QCommandLineOption historyBudgetOption("history-budget", "Flatten old strokes once their data exceeds this size (0 for no limit).", "MB");
+    parser.addOption(historyBudgetOption);
+
+    // --- Board Options ---
+    QCommandLineOption openOption("open", "Load a saved board on startup.", "file");
+    parser.addOption(openOption);
+
+    QCommandLineOption saveOption("save", "Save the board to this file on exit.", "file");
+    parser.addOption(saveOption);
+
+    // --- Diagnostics ---
+    QCommandLineOption recordTraceOption("record-trace", "Record mouse input to this file, with the starting board next to it, for replaying later.", "file");
+    parser.addOption(recordTraceOption);
+
+    QCommandLineOption replayTraceOption("replay-trace", "Replay a recorded trace, report event-to-pixel latency and exit. Nothing is saved.", "file");
+    parser.addOption(replayTraceOption);
+
+    QCommandLineOption replaySpeedOption("replay-speed", "Speed factor for --replay-trace; 0 replays as fast as possible.", "factor", "1");
+    parser.addOption(replaySpeedOption);
+
+    QCommandLineOption metricsOption("metrics", "Write frame, latency, memory and startup metrics at this interval, to stderr or --metrics-file.", "ms");
+    parser.addOption(metricsOption);
+
+    QCommandLineOption metricsFileOption("metrics-file", "Append --metrics samples to this file instead of stderr.", "file");
+    parser.addOption(metricsFileOption);
+
+    QCommandLineOption traceOption("trace", "Record trace zones and write them on exit as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).", "file");
+    parser.addOption(traceOption);
+
     // --- Other Options ---
     QCommandLineOption resetOption({"r", "reset"}, "Reset all saved settings to their defaults.");
     parser.addOption(resetOption);
 
-    QCommandLineOption neverSaveOption({"n", "never-save"}, "Disable saving settings for this session.");
+    QCommandLineOption neverSaveOption({"n", "never-save"}, "Disable saving settings and the board for this session.");
     parser.addOption(neverSaveOption);
 
     parser.process(a);
 
+    // Before anything else, so startup shows up in the trace too
+    if (parser.isSet(traceOption)) Trace::start(parser.value(traceOption));
+
+    // --- Single Instance ---
+    // A resident instance handles a bare launch by showing itself. Any option asks for
+    // something it can't apply after the fact, so those launches start their own instance.
+    const bool sending = parser.isSet(sendOption);
+    if (sending || parser.optionNames().isEmpty()) {
+        const QString command = sending ? parser.value(sendOption) : "show";
+        QString reply;
+        if (Daemon::send(command, &reply)) {
+            if (reply == "ok") return 0;
+            qWarning().noquote() << command + ":" << reply;
+            return 1;
+        }
+        if (sending && command != "show" && command != "toggle") {
+            qWarning() << "No resident instance is running";
+            return 1;
+        }
+    }
+    Daemon daemon;
+    if (sending || parser.isSet(daemonOption)) {
+        if (!daemon.listen()) {
+            qWarning() << "Another instance is already resident";
+            return 1;
+        }
+        QApplication::setQuitOnLastWindowClosed(false);
+    }
+
     // --- Package options for MainWindow ---
     QVariantMap cmdLineOptions;
     if (parser.isSet(cleanOption)) cmdLineOptions["clean"] = true;
     if (parser.isSet(resetOption)) cmdLineOptions["reset"] = true;
     if (parser.isSet(neverSaveOption)) cmdLineOptions["never-save"] = true;
+    if (sending || parser.isSet(daemonOption)) cmdLineOptions["daemon"] = true;
 
     if (parser.isSet(modeOption)) cmdLineOptions["mode"] = parser.value(modeOption);
     if (parser.isSet(hueOption)) cmdLineOptions["hue"] = parser.value(hueOption).toInt();
@@ -68,9 +149,31 @@ int main(int argc, char *argv[])
     if (parser.isSet(sizeOption)) cmdLineOptions["size"] = parser.value(sizeOption).toInt();
     if (parser.isSet(textSizeOption)) cmdLineOptions["text-size"] = parser.value(textSizeOption).toInt();
     if (parser.isSet(toolOption)) cmdLineOptions["tool"] = parser.value(toolOption);
+    if (parser.isSet(simplifyOption)) cmdLineOptions["simplify"] = parser.value(simplifyOption).toDouble();
+    if (parser.isSet(liveAntialiasOption)) cmdLineOptions["live-aa-limit"] = parser.value(liveAntialiasOption).toInt();
+    if (parser.isSet(historyDepthOption)) cmdLineOptions["history-depth"] = parser.value(historyDepthOption).toInt();
+    if (parser.isSet(historyBudgetOption)) cmdLineOptions["history-budget"] = parser.value(historyBudgetOption).toInt();
+    if (parser.isSet(openOption)) cmdLineOptions["open"] = parser.value(openOption);
+    if (parser.isSet(saveOption)) cmdLineOptions["save"] = parser.value(saveOption);
+    if (parser.isSet(metricsOption)) cmdLineOptions["metrics"] = parser.value(metricsOption).toInt();
+    if (parser.isSet(metricsFileOption)) cmdLineOptions["metrics-file"] = parser.value(metricsFileOption);
+    if (parser.isSet(recordTraceOption)) cmdLineOptions["record-trace"] = parser.value(recordTraceOption);
+    if (parser.isSet(replayTraceOption)) {
+        cmdLineOptions["replay-trace"] = parser.value(replayTraceOption);
+        cmdLineOptions["replay-speed"] = parser.value(replaySpeedOption).toDouble();
+        // A replay must not overwrite the user's settings or autosaved board
+        cmdLineOptions["never-save"] = true;
+    }
 
     MainWindow w(cmdLineOptions);
-    w.show();
-
-    return a.exec();
+    QObject::connect(&daemon, &Daemon::commandReceived, &w, &MainWindow::handleCommand);
+    // A daemon started on its own waits to be shown
+    if (sending || !parser.isSet(daemonOption)) {
+        w.measureFirstPaint(launchClock);
+        w.show();
+    }
+
+    const int status = a.exec();
+    Trace::stop();
+    return status;
 }
\ No newline at end of file
@@ -6,13 +6,26 @@
 #include <QSettings>
 #include <QCloseEvent>
 #include <QVariantMap>
+#include <QStandardPaths>
+#include <QApplication>
+#include <QTimer>
+#include <QDateTime>
+#include <QDebug>
+#include <utility>
+#include "inputtrace.h"
+#include "trace.h"
 
 MainWindow::MainWindow(const QVariantMap &cmdLineOptions, QWidget *parent)
     : QMainWindow(parent),
-      m_cmdLineOptions(cmdLineOptions),
       m_isLeftButtonPressed(false),
-      m_isRightButtonPressed(false)
+      m_isRightButtonPressed(false),
+      m_resident(cmdLineOptions.contains("daemon")),
+      m_metricsOut(nullptr),
+      m_firstPaintMs(-1),
+      m_cmdLineOptions(cmdLineOptions),
+      helpPanel(nullptr)
 {
+    TRACE_SCOPE("MainWindow::MainWindow");
     // Make the main window transparent and frameless
     setAttribute(Qt::WA_TranslucentBackground);
     setWindowFlags(Qt::FramelessWindowHint);
@@ -24,17 +37,12 @@ MainWindow::MainWindow(const QVariantMap &cmdLineOptions, QWidget *parent)
     stackedWidget = new QStackedWidget(this);
     setCentralWidget(stackedWidget);
 
-    // Create the widgets
+    // Create the canvas; the help panel follows when it is first shown
     canvas = new Canvas(this);
-    helpPanel = new HelpPanel(this);
-
-    // Add them to the stack
     stackedWidget->addWidget(canvas);
-    stackedWidget->addWidget(helpPanel);
 
-    // Install event filter on both widgets to catch global mouse events
+    // Install event filter to catch global mouse events
     canvas->installEventFilter(this);
-    helpPanel->installEventFilter(this);
 
     // --- Connect Signals and Slots ---
     connect(canvas, &Canvas::rightButtonClicked, canvas, &Canvas::clearCanvas);
@@ -43,16 +51,65 @@ MainWindow::MainWindow(const QVariantMap &cmdLineOptions, QWidget *parent)
 
     // --- Load Settings or Set Defaults ---
     if (m_cmdLineOptions.contains("reset")) {
-        QSettings settings;
-        settings.clear();
+        m_settings.clear();
     }
     loadSettings();
 
+    // The board survives crashes and kills, not just a clean exit
+    if (!m_cmdLineOptions.contains("never-save")) {
+        canvas->openJournal(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation), !m_cmdLineOptions.contains("clean"));
+    }
+    if (m_cmdLineOptions.contains("open")) {
+        canvas->loadBoard(m_cmdLineOptions["open"].toString());
+    }
+
+    // --- Metrics ---
+    if (m_cmdLineOptions.contains("metrics")) {
+        m_metricsOut = new QFile(this);
+        bool opened;
+        if (m_cmdLineOptions.contains("metrics-file")) {
+            m_metricsOut->setFileName(m_cmdLineOptions["metrics-file"].toString());
+            opened = m_metricsOut->open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+        } else {
+            opened = m_metricsOut->open(stderr, QIODevice::WriteOnly | QIODevice::Text);
+        }
+        if (opened) {
+            QTimer *metricsTimer = new QTimer(this);
+            connect(metricsTimer, &QTimer::timeout, this, &MainWindow::writeMetrics);
+            metricsTimer->start(std::max(100, m_cmdLineOptions["metrics"].toInt()));
+        } else {
+            qWarning() << "Cannot write metrics to" << m_metricsOut->fileName() << m_metricsOut->errorString();
+        }
+    }
+
+    // --- Input Traces ---
+    // A trace starts from default settings and the board stored next to it, so it
+    // replays the same way on any machine. Installed last, the recorder's filter
+    // runs before ours and sees the events it swallows. Events are matched to widgets by
+    // index, so the help panel exists from the start.
+    if (m_cmdLineOptions.contains("record-trace")) {
+        const QString trace = m_cmdLineOptions["record-trace"].toString();
+        canvas->saveBoard(trace + ".crb");
+        TraceRecorder *recorder = new TraceRecorder(trace, this);
+        recorder->watch(canvas);
+        recorder->watch(ensureHelpPanel());
+    }
+    if (m_cmdLineOptions.contains("replay-trace")) {
+        const QString trace = m_cmdLineOptions["replay-trace"].toString();
+        canvas->loadBoard(trace + ".crb");
+        TracePlayer *player = new TracePlayer(trace, m_cmdLineOptions.value("replay-speed", 1.0).toDouble(), canvas->frames(), this);
+        player->watch(canvas);
+        player->watch(ensureHelpPanel());
+        connect(player, &TracePlayer::finished, qApp, &QApplication::quit);
+        // Once the window is up
+        QTimer::singleShot(0, player, player->isValid() ? &TracePlayer::start : &TracePlayer::finished);
+    }
+
     // --- Set Initial View ---
     if (m_cmdLineOptions.contains("clean")) {
         stackedWidget->setCurrentWidget(canvas);
     } else {
-        stackedWidget->setCurrentWidget(helpPanel);
+        stackedWidget->setCurrentWidget(ensureHelpPanel());
     }
 }
 
@@ -60,17 +117,69 @@ MainWindow::~MainWindow()
 {
 }
 
+HelpPanel *MainWindow::ensureHelpPanel()
+{
+    if (!helpPanel) {
+        TRACE_SCOPE("MainWindow::ensureHelpPanel");
+        helpPanel = new HelpPanel(this);
+        stackedWidget->addWidget(helpPanel);
+        helpPanel->installEventFilter(this);
+    }
+    return helpPanel;
+}
+
+void MainWindow::measureFirstPaint(const QElapsedTimer &since)
+{
+    m_paintClock = since;
+}
+
 void MainWindow::closeEvent(QCloseEvent *event)
 {
+    TRACE_SCOPE("MainWindow::closeEvent");
     if (!m_cmdLineOptions.contains("never-save")) {
         saveSettings();
     }
+    if (m_cmdLineOptions.contains("save")) {
+        canvas->saveBoard(m_cmdLineOptions["save"].toString());
+    }
+    if (m_resident) {
+        // A close by the two-button chord hides the window before either release arrives
+        m_isLeftButtonPressed = false;
+        m_isRightButtonPressed = false;
+        event->ignore();
+        hide();
+        return;
+    }
     QMainWindow::closeEvent(event);
 }
 
+void MainWindow::handleCommand(const QString &command)
+{
+    TRACE_SCOPE("MainWindow::handleCommand");
+    if (command == "show" || (command == "toggle" && !isVisible())) {
+        if (!isVisible()) {
+            // Toggle-to-draw, the latency a resident instance is there to keep low
+            QElapsedTimer clock;
+            clock.start();
+            measureFirstPaint(clock);
+        }
+        show();
+        raise();
+        activateWindow();
+    } else if (command == "hide" || command == "toggle") {
+        close();
+    } else if (command == "clear") {
+        canvas->clearCanvas();
+    } else if (command == "quit") {
+        m_resident = false;
+        close();
+        QApplication::quit();
+    }
+}
+
 void MainWindow::loadSettings()
 {
-    QSettings settings;
+    TRACE_SCOPE("MainWindow::loadSettings");
     canvas->beginInitialization();
 
     // --- Priority: Command Line > Settings File > Defaults ---
@@ -79,27 +188,35 @@ void MainWindow::loadSettings()
     applyDefaultSettings();
 
     // Load from settings file if it exists and is complete
-    bool settingsAreComplete = settings.contains("Tool/current") && settings.contains("Size/general");
+    const bool tracing = m_cmdLineOptions.contains("record-trace") || m_cmdLineOptions.contains("replay-trace");
+    bool settingsAreComplete = !tracing && m_settings.contains("Tool/current") && m_settings.contains("Size/general");
     if (settingsAreComplete) {
-        canvas->setInitialPenWidth(settings.value("Size/general").toInt());
-        canvas->setInitialTextSize(settings.value("Size/text").toInt());
+        canvas->setInitialPenWidth(m_settings.value("Size/general").toInt());
+        canvas->setInitialTextSize(m_settings.value("Size/text").toInt());
         QColor color;
         color.setHsv(
-            settings.value("Color/hue").toInt(),
-            settings.value("Color/saturation").toInt(),
-            settings.value("Color/value").toInt(),
-            settings.value("Color/opacity").toInt()
+            m_settings.value("Color/hue").toInt(),
+            m_settings.value("Color/saturation").toInt(),
+            m_settings.value("Color/value").toInt(),
+            m_settings.value("Color/opacity").toInt()
         );
         canvas->setPenColor(color);
-        canvas->setTool(Canvas::toolFromString(settings.value("Tool/current").toString()));
-        canvas->setScrollMode(Canvas::scrollModeFromString(settings.value("Mode/current").toString()));
+        canvas->setTool(Canvas::toolFromString(m_settings.value("Tool/current").toString()));
+        canvas->setScrollMode(Canvas::scrollModeFromString(m_settings.value("Mode/current").toString()));
     }
+    // Added later than the rest, so older files may not have them
+    if (!tracing && m_settings.contains("History/depth")) canvas->setHistoryDepth(m_settings.value("History/depth").toInt());
+    if (!tracing && m_settings.contains("History/budget")) canvas->setHistoryBudget(m_settings.value("History/budget").toInt());
 
     // Override with command line options if they exist
     if (m_cmdLineOptions.contains("size")) canvas->setInitialPenWidth(m_cmdLineOptions["size"].toInt());
     if (m_cmdLineOptions.contains("text-size")) canvas->setInitialTextSize(m_cmdLineOptions["text-size"].toInt());
     if (m_cmdLineOptions.contains("tool")) canvas->setTool(Canvas::toolFromString(m_cmdLineOptions["tool"].toString()));
     if (m_cmdLineOptions.contains("mode")) canvas->setScrollMode(Canvas::scrollModeFromString(m_cmdLineOptions["mode"].toString()));
+    if (m_cmdLineOptions.contains("simplify")) canvas->setSimplifyTolerance(m_cmdLineOptions["simplify"].toDouble());
+    if (m_cmdLineOptions.contains("live-aa-limit")) canvas->setLiveAntialiasLimit(m_cmdLineOptions["live-aa-limit"].toInt());
+    if (m_cmdLineOptions.contains("history-depth")) canvas->setHistoryDepth(m_cmdLineOptions["history-depth"].toInt());
+    if (m_cmdLineOptions.contains("history-budget")) canvas->setHistoryBudget(m_cmdLineOptions["history-budget"].toInt());
 
     QColor finalColor = canvas->getColor();
     if (m_cmdLineOptions.contains("hue")) finalColor.setHsv(m_cmdLineOptions["hue"].toInt(), finalColor.saturation(), finalColor.value(), finalColor.alpha());
@@ -113,11 +230,37 @@ void MainWindow::loadSettings()
 
 void MainWindow::resetSettings()
 {
-    QSettings settings;
-    settings.clear();
+    TRACE_SCOPE("MainWindow::resetSettings");
+    m_settings.clear();
     applyDefaultSettings();
 }
 
+void MainWindow::writeMetrics()
+{
+    TRACE_SCOPE("MainWindow::writeMetrics");
+    // One line per sample, as key=value pairs; times are last/average/worst
+    const Canvas::Metrics m = canvas->metrics();
+    const FrameScheduler::Stats &f = m.frames;
+    QStringList fields = {
+        QDateTime::currentDateTime().toString(Qt::ISODateWithMs),
+        QString("frames=%1").arg(f.frames),
+        QString("dropped=%1").arg(f.droppedFrames),
+        QString("frame_ms=%1").arg(f.frameMs, 0, 'f', 2),
+        QString("paint_ms=%1/%2/%3").arg(f.lastPaintMs, 0, 'f', 2).arg(f.averagePaintMs, 0, 'f', 2).arg(f.worstPaintMs, 0, 'f', 2),
+        QString("latency_ms=%1/%2/%3").arg(f.lastLatencyMs, 0, 'f', 2).arg(f.averageLatencyMs, 0, 'f', 2).arg(f.worstLatencyMs, 0, 'f', 2),
+        QString("entries=%1").arg(m.entries),
+        QString("redo=%1").arg(m.redoEntries),
+        QString("points=%1").arg(m.points),
+        QString("stored_points=%1").arg(m.storedPoints),
+        QString("history_mb=%1").arg(m.historyBytes / 1048576.0, 0, 'f', 1),
+        QString("cache_mb=%1").arg(m.cacheBytes / 1048576.0, 0, 'f', 1)
+    };
+    // Launch, or the last show, to its first frame
+    if (m_firstPaintMs >= 0) fields.append(QString("first_paint_ms=%1").arg(m_firstPaintMs, 0, 'f', 2));
+    m_metricsOut->write((fields.join(' ') + '\n').toUtf8());
+    m_metricsOut->flush();
+}
+
 void MainWindow::applyDefaultSettings()
 {
     // This function now only sets the base default values
@@ -134,46 +277,67 @@ void MainWindow::applyDefaultSettings()
 
     canvas->setTool(Tool::Pen);
     canvas->setScrollMode(ScrollMode::History);
+    canvas->setHistoryDepth(Constants::HISTORY_DEPTH);
+    canvas->setHistoryBudget(Constants::HISTORY_BUDGET_MB);
 }
 
 void MainWindow::saveSettings()
 {
-    QSettings settings;
-    settings.beginGroup("Color");
+    TRACE_SCOPE("MainWindow::saveSettings");
+    m_settings.beginGroup("Color");
     QColor color = canvas->getColor();
-    settings.setValue("hue", color.hue());
-    settings.setValue("saturation", color.saturation());
-    settings.setValue("value", color.value());
-    settings.setValue("opacity", color.alpha());
-    settings.endGroup();
-
-    settings.beginGroup("Size");
-    settings.setValue("general", canvas->getPenWidth());
-    settings.setValue("text", canvas->getTextSize());
-    settings.endGroup();
-
-    settings.setValue("Tool/current", canvas->toolToString(canvas->getTool()));
-    settings.setValue("Mode/current", canvas->scrollModeToString());
+    m_settings.setValue("hue", color.hue());
+    m_settings.setValue("saturation", color.saturation());
+    m_settings.setValue("value", color.value());
+    m_settings.setValue("opacity", color.alpha());
+    m_settings.endGroup();
+
+    m_settings.beginGroup("Size");
+    m_settings.setValue("general", canvas->getPenWidth());
+    m_settings.setValue("text", canvas->getTextSize());
+    m_settings.endGroup();
+
+    m_settings.setValue("Tool/current", canvas->toolToString(canvas->getTool()));
+    m_settings.setValue("Mode/current", canvas->scrollModeToString());
+
+    m_settings.beginGroup("History");
+    m_settings.setValue("depth", canvas->getHistoryDepth());
+    m_settings.setValue("budget", canvas->getHistoryBudget());
+    m_settings.endGroup();
 }
 
 void MainWindow::keyPressEvent(QKeyEvent *event)
 {
+    TRACE_SCOPE("MainWindow::keyPressEvent");
     if (event->key() == Qt::Key_Escape) {
         close();
+    } else if (event->key() == Qt::Key_F12) {
+        canvas->toggleHud();
     }
     QMainWindow::keyPressEvent(event);
 }
 
 void MainWindow::toggleHelpPanel()
 {
-    int currentIndex = stackedWidget->currentIndex();
-    int nextIndex = (currentIndex + 1) % stackedWidget->count();
-    stackedWidget->setCurrentIndex(nextIndex);
+    TRACE_SCOPE("MainWindow::toggleHelpPanel");
+    if (stackedWidget->currentWidget() == canvas) {
+        stackedWidget->setCurrentWidget(ensureHelpPanel());
+    } else {
+        stackedWidget->setCurrentWidget(canvas);
+    }
 }
 
 bool MainWindow::eventFilter(QObject *obj, QEvent *event)
 {
-    if (event->type() == QEvent::MouseButtonPress) {
+    TRACE_SCOPE("MainWindow::eventFilter");
+    if (event->type() == QEvent::Paint && m_paintClock.isValid()) {
+        // Read once control is back in the event loop, after the frame has been flushed
+        const QElapsedTimer clock = std::exchange(m_paintClock, QElapsedTimer());
+        QTimer::singleShot(0, this, [this, clock] {
+            m_firstPaintMs = clock.nsecsElapsed() / 1e6;
+            emit firstPainted(m_firstPaintMs);
+        });
+    } else if (event->type() == QEvent::MouseButtonPress) {
         QMouseEvent *mouseEvent = static_cast<QMouseEvent*>(event);
         if (mouseEvent->button() == Qt::LeftButton) {
             m_isLeftButtonPressed = true;
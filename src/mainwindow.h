@@ -7,6 +7,9 @@
 #include "canvas.h"
 #include "helppanel.h"
 #include <QVariantMap>
+#include <QFile>
+#include <QSettings>
+#include <QElapsedTimer>
 
 class MainWindow : public QMainWindow
 {
@@ -16,6 +19,16 @@ public:
     explicit MainWindow(const QVariantMap &cmdLineOptions, QWidget *parent = nullptr);
     ~MainWindow();
 
+    // Times the next frame to reach the screen from `since`, such as process start
+    void measureFirstPaint(const QElapsedTimer &since);
+
+signals:
+    void firstPainted(qreal ms);
+
+public slots:
+    // show, hide, toggle, clear or quit, from another invocation (see Daemon)
+    void handleCommand(const QString &command);
+
 protected:
     void keyPressEvent(QKeyEvent *event) override;
     bool eventFilter(QObject *obj, QEvent *event) override;
@@ -24,14 +37,26 @@ protected:
 private slots:
     void toggleHelpPanel();
     void resetSettings();
+    void writeMetrics();
 
 private:
     void loadSettings();
     void saveSettings();
     void applyDefaultSettings();
+    // The help panel is only built the first time it is shown
+    HelpPanel *ensureHelpPanel();
 
     bool m_isLeftButtonPressed;
     bool m_isRightButtonPressed;
+    // Closing only hides the window; the process stays for the next activation
+    bool m_resident;
+    // Where --metrics samples go, if requested
+    QFile *m_metricsOut;
+    // Opened once; loading, resetting and saving all go through it
+    QSettings m_settings;
+    // Running from a launch or show until its first frame; the result in ms, -1 before one
+    QElapsedTimer m_paintClock;
+    qreal m_firstPaintMs;
 
     QVariantMap m_cmdLineOptions;
 
@@ -0,0 +1,136 @@
+#include "overlay.h"
+#include <QPainter>
+#include <QFontDatabase>
+#include "canvas.h"
+#include "trace.h"
+
+Overlay::Overlay(FrameScheduler *frames, QWidget *parent)
+    : QWidget(parent), m_frames(frames), m_brushVisible(false), m_penWidth(1), m_indicatorVisible(false),
+      m_hudFontLoaded(false), m_labels(Constants::GLYPH_CACHE_BUDGET_KB)
+{
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    setAttribute(Qt::WA_TranslucentBackground);
+}
+
+void Overlay::setBrush(bool visible, const QPoint &pos, int penWidth, const QColor &color)
+{
+    if (visible == m_brushVisible && pos == m_brushPos && penWidth == m_penWidth && color == m_brushColor) return;
+    m_brushVisible = visible;
+    m_brushPos = pos;
+    m_penWidth = penWidth;
+    m_brushColor = color;
+    refresh();
+}
+
+void Overlay::setIndicator(bool visible, const QString &mainText, const QString &subText)
+{
+    if (visible == m_indicatorVisible && mainText == m_mainText && subText == m_subText) return;
+    m_indicatorVisible = visible;
+    m_mainText = mainText;
+    m_subText = subText;
+    refresh();
+}
+
+void Overlay::setHud(const QStringList &lines)
+{
+    if (lines == m_hudLines) return;
+    // Looked up on first use rather than at startup, since most sessions never show the HUD
+    if (!lines.isEmpty() && !m_hudFontLoaded) {
+        m_hudFont = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+        m_hudFontLoaded = true;
+    }
+    m_hudLines = lines;
+    refresh();
+}
+
+void Overlay::paintEvent(QPaintEvent *event)
+{
+    TRACE_SCOPE("Overlay::paintEvent");
+    Q_UNUSED(event);
+    QPainter painter(this);
+
+    if (!m_hudLines.isEmpty()) {
+        painter.fillRect(m_hudRect, QColor(0, 0, 0, 160));
+        painter.setPen(Qt::white);
+        painter.setFont(m_hudFont);
+        const QFontMetrics fm(m_hudFont);
+        QPoint baseline = m_hudRect.topLeft() + QPoint(Constants::HUD_PADDING, Constants::HUD_PADDING + fm.ascent());
+        for (const QString &line : m_hudLines) {
+            painter.drawText(baseline, line);
+            baseline.ry() += fm.lineSpacing();
+        }
+    }
+
+    painter.setRenderHint(QPainter::Antialiasing, true);
+
+    if (!m_brushVisible) return;
+
+    // Draw cursor
+    if (!m_brushColor.isValid()) {
+        painter.setPen(Qt::white);
+        painter.setBrush(Qt::transparent);
+    } else {
+        QPen cursorPen(m_brushColor);
+        cursorPen.setWidth(1);
+        painter.setPen(cursorPen);
+        painter.setBrush(m_brushColor);
+    }
+    painter.drawEllipse(m_brushPos, m_penWidth / 2, m_penWidth / 2);
+
+    // Draw mode indicator text if active
+    if (m_indicatorVisible) {
+        const QPoint textPos = indicatorTextPos();
+        GlyphCache::draw(painter, textPos, m_labels.text(m_mainText, font(), Qt::white, this, Qt::black));
+        if (!m_subText.isEmpty()) {
+            GlyphCache::draw(painter, textPos + QPoint(0, 18), m_labels.text(m_subText, font(), Qt::white, this, Qt::black));
+        }
+    }
+}
+
+QPoint Overlay::indicatorTextPos() const
+{
+    return m_brushPos + QPoint(m_penWidth / 2 + 15, m_penWidth / 2 + 15);
+}
+
+QRect Overlay::brushRect() const
+{
+    if (!m_brushVisible) return QRect();
+    const int radius = m_penWidth / 2;
+    // Pad for the 1px outline and its antialiased fringe
+    return QRect(m_brushPos - QPoint(radius, radius), QSize(2 * radius + 1, 2 * radius + 1)).adjusted(-2, -2, 2, 2);
+}
+
+QRect Overlay::indicatorRect() const
+{
+    if (!m_brushVisible || !m_indicatorVisible) return QRect();
+    const QFontMetrics fm = fontMetrics();
+    const QPoint textPos = indicatorTextPos();
+    QRect rect = fm.boundingRect(m_mainText).translated(textPos);
+    if (!m_subText.isEmpty()) {
+        rect |= fm.boundingRect(m_subText).translated(textPos + QPoint(0, 18));
+    }
+    // Pad for the 1px outline copies and antialiasing
+    return rect.adjusted(-3, -3, 3, 3);
+}
+
+QRect Overlay::hudRect() const
+{
+    if (m_hudLines.isEmpty()) return QRect();
+    const QFontMetrics fm(m_hudFont);
+    int width = 0;
+    for (const QString &line : m_hudLines) {
+        width = std::max(width, fm.horizontalAdvance(line));
+    }
+    const int margin = Constants::HUD_PADDING;
+    return QRect(margin, margin, width + 2 * margin, int(m_hudLines.size()) * fm.lineSpacing() + 2 * margin);
+}
+
+void Overlay::refresh()
+{
+    // Damage both where the cursor, indicator and HUD were last drawn and where they are now
+    QRegion dirty = QRegion(m_brushRect) + m_indicatorRect + m_hudRect;
+    m_brushRect = brushRect();
+    m_indicatorRect = indicatorRect();
+    m_hudRect = hudRect();
+    m_frames->schedule(this, dirty + m_brushRect + m_indicatorRect + m_hudRect);
+}
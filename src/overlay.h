@@ -0,0 +1,62 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <QWidget>
+#include <QPaintEvent>
+#include <QColor>
+#include <QRegion>
+#include <QStringList>
+#include <QFont>
+#include "framescheduler.h"
+#include "glyphcache.h"
+
+// Transparent child layer above the canvas for the brush cursor, the mode
+// indicator and the performance HUD. It repaints only its own small damaged areas,
+// so hovering and wheel feedback never redraw strokes; what's underneath comes
+// from the tile cache.
+class Overlay : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit Overlay(FrameScheduler *frames, QWidget *parent = nullptr);
+
+    // An invalid color draws the eraser's outline-only cursor
+    void setBrush(bool visible, const QPoint &pos, int penWidth, const QColor &color);
+    void setIndicator(bool visible, const QString &mainText, const QString &subText);
+    // Lines for the HUD in the top-left corner; none hides it
+    void setHud(const QStringList &lines);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    QPoint indicatorTextPos() const;
+    QRect brushRect() const;
+    QRect indicatorRect() const;
+    QRect hudRect() const;
+    void refresh();
+
+    FrameScheduler *m_frames;
+    bool m_brushVisible;
+    QPoint m_brushPos;
+    int m_penWidth;
+    QColor m_brushColor;
+    bool m_indicatorVisible;
+    QString m_mainText;
+    QString m_subText;
+    // Changes every update, so it is drawn directly rather than through the label cache
+    QStringList m_hudLines;
+    QFont m_hudFont;
+    bool m_hudFontLoaded;
+
+    // Outlined labels, so wheel feedback blits pixels instead of shaping text five times over
+    GlyphCache m_labels;
+
+    // Last damaged cursor and indicator areas, so a move repaints exactly old plus new
+    QRect m_brushRect;
+    QRect m_indicatorRect;
+    QRect m_hudRect;
+};
+
+#endif // OVERLAY_H
@@ -0,0 +1,103 @@
+#include "rasterhistory.h"
+#include <QSet>
+#include <climits>
+#include <iterator>
+
+RasterHistory::RasterHistory(qint64 memoryBudget)
+    : m_memoryBudget(memoryBudget)
+{
+}
+
+void RasterHistory::setMemoryBudget(qint64 bytes)
+{
+    m_memoryBudget = bytes;
+    enforceBudget();
+}
+
+int RasterHistory::nearestCheckpoint(int count) const
+{
+    auto it = m_checkpoints.upperBound(count);
+    if (it == m_checkpoints.constBegin()) return 0;
+    return (--it).key();
+}
+
+int RasterHistory::restore(int count, QVector<QImage> *tiles) const
+{
+    auto it = m_checkpoints.upperBound(count);
+    if (it == m_checkpoints.constBegin()) return 0;
+    --it;
+    *tiles = it.value(); // Implicitly shared; a tile detaches on the first replayed stroke
+    return it.key();
+}
+
+void RasterHistory::record(int count, const QVector<QImage> &tiles)
+{
+    if (count <= 0) return;
+    m_checkpoints.insert(count, tiles);
+    enforceBudget();
+}
+
+void RasterHistory::truncate(int count)
+{
+    m_checkpoints.erase(m_checkpoints.upperBound(count), m_checkpoints.end());
+}
+
+void RasterHistory::dropFront(int count)
+{
+    QMap<int, QVector<QImage>> checkpoints;
+    for (auto it = m_checkpoints.lowerBound(count); it != m_checkpoints.end(); ++it) {
+        checkpoints.insert(it.key() - count, it.value());
+    }
+    m_checkpoints = checkpoints;
+}
+
+void RasterHistory::setBase(const QVector<QImage> &tiles)
+{
+    m_checkpoints.insert(0, tiles);
+    enforceBudget();
+}
+
+void RasterHistory::clear()
+{
+    m_checkpoints.clear();
+}
+
+qint64 RasterHistory::memoryUsage() const
+{
+    // Tiles that were not painted over between checkpoints still share their pixels
+    QSet<qint64> counted;
+    qint64 bytes = 0;
+    for (const QVector<QImage> &tiles : m_checkpoints) {
+        for (const QImage &image : tiles) {
+            if (!image.isNull() && !counted.contains(image.cacheKey())) {
+                counted.insert(image.cacheKey());
+                bytes += image.sizeInBytes();
+            }
+        }
+    }
+    return bytes;
+}
+
+void RasterHistory::enforceBudget()
+{
+    // Thin out the densest part of the history first, so keyframes stay spread over
+    // the whole session instead of only covering its recent end. The newest
+    // checkpoint is kept since it is the one undo reaches first, and the base layer
+    // since nothing else holds what it shows.
+    const int keep = m_checkpoints.contains(0) ? 2 : 1;
+    while (m_checkpoints.size() > keep && memoryUsage() > m_memoryBudget) {
+        auto victim = m_checkpoints.end();
+        int smallestGap = INT_MAX;
+        int previous = 0;
+        for (auto it = m_checkpoints.begin(); it != std::prev(m_checkpoints.end()); ++it) {
+            if (it.key() == 0) continue;
+            const int gap = it.key() - previous;
+            if (gap < smallestGap) {
+                smallestGap = gap;
+                victim = it;
+            }
+            previous = it.key();
+        }
+        m_checkpoints.erase(victim);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef RASTERHISTORY_H
+#define RASTERHISTORY_H
+
+#include <QImage>
+#include <QMap>
+#include <QVector>
+
+// Keyframes of the tiled stroke cache, keyed by the number of committed strokes
+// they contain. Rebuilding a tile for any history position then only has to restore
+// the nearest keyframe at or below it and replay the tail. Keyframes hold implicitly
+// shared tile images, so tiles that did not change between two keyframes are stored once.
+// A keyframe at 0 is the base layer: strokes compacted out of the store that every
+// other position is built on.
+class RasterHistory
+{
+public:
+    // Older keyframes are thinned out once they take more than `memoryBudget` bytes
+    explicit RasterHistory(qint64 memoryBudget);
+
+    void setMemoryBudget(qint64 bytes);
+
+    // Index of the nearest checkpoint at or below `count`, or 0 if there is none
+    int nearestCheckpoint(int count) const;
+    // Copies the nearest checkpoint into `tiles` and returns its index; returns 0 and
+    // leaves `tiles` untouched if there is none
+    int restore(int count, QVector<QImage> *tiles) const;
+
+    void record(int count, const QVector<QImage> &tiles);
+    // Drops checkpoints past `count`, for when the redo branch is discarded
+    void truncate(int count);
+    // Makes the checkpoint at `count` the base layer and renumbers later ones to match
+    // a store that dropped its first `count` strokes
+    void dropFront(int count);
+    void setBase(const QVector<QImage> &tiles);
+    void clear();
+
+    int checkpointCount() const { return m_checkpoints.size(); }
+    bool hasBase() const { return m_checkpoints.contains(0); }
+    qint64 memoryUsage() const;
+
+private:
+    void enforceBudget();
+
+    QMap<int, QVector<QImage>> m_checkpoints;
+    qint64 m_memoryBudget;
+};
+
+#endif // RASTERHISTORY_H
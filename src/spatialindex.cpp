@@ -0,0 +1,95 @@
+#include "spatialindex.h"
+#include <algorithm>
+
+SpatialIndex::SpatialIndex(int cellSize)
+    : m_cellSize(cellSize)
+{
+}
+
+quint64 SpatialIndex::cellKey(int x, int y)
+{
+    return (quint64(quint32(x)) << 32) | quint32(y);
+}
+
+QRect SpatialIndex::cellRange(const QRect &bounds) const
+{
+    // Floor division, since strokes may start off-screen at negative coordinates
+    auto cell = [this](int v) { return v >= 0 ? v / m_cellSize : -((-v - 1) / m_cellSize) - 1; };
+    return QRect(QPoint(cell(bounds.left()), cell(bounds.top())),
+                 QPoint(cell(bounds.right()), cell(bounds.bottom())));
+}
+
+void SpatialIndex::append(const QRect &bounds)
+{
+    const int id = m_bounds.size();
+    m_bounds.append(bounds);
+    if (bounds.isEmpty()) return;
+
+    const QRect cells = cellRange(bounds);
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            m_cells[cellKey(x, y)].append(id);
+        }
+    }
+}
+
+void SpatialIndex::removeLast()
+{
+    if (m_bounds.isEmpty()) return;
+
+    const QRect bounds = m_bounds.takeLast();
+    if (bounds.isEmpty()) return;
+
+    const QRect cells = cellRange(bounds);
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            auto it = m_cells.find(cellKey(x, y));
+            if (it == m_cells.end()) continue;
+            it->removeLast(); // The last appended id is always at the back of its cells
+            if (it->isEmpty()) m_cells.erase(it);
+        }
+    }
+}
+
+void SpatialIndex::clear()
+{
+    m_bounds.clear();
+    m_cells.clear();
+}
+
+QVector<int> SpatialIndex::query(const QRect &rect) const
+{
+    QVector<int> result;
+    if (rect.isEmpty()) return result;
+
+    const QRect cells = cellRange(rect);
+    if (qint64(cells.width()) * cells.height() >= m_cells.size()) {
+        // Covering more cells than are populated; a straight scan is cheaper
+        for (int id = 0; id < m_bounds.size(); ++id) {
+            if (m_bounds.at(id).intersects(rect)) result.append(id);
+        }
+        return result;
+    }
+
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            auto it = m_cells.constFind(cellKey(x, y));
+            if (it == m_cells.constEnd()) continue;
+            for (int id : *it) {
+                if (m_bounds.at(id).intersects(rect)) result.append(id);
+            }
+        }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+void SpatialIndex::dropFront(int count)
+{
+    const QVector<QRect> remaining = m_bounds.mid(count);
+    clear();
+    for (const QRect &bounds : remaining) {
+        append(bounds);
+    }
+}
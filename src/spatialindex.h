@@ -0,0 +1,37 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <QRect>
+#include <QVector>
+#include <QHash>
+
+// Uniform grid over stroke bounds. Ids are the stroke's position in history, so they
+// are always appended in increasing order and removed from the end, which keeps
+// every cell's list sorted without any extra work.
+class SpatialIndex
+{
+public:
+    explicit SpatialIndex(int cellSize);
+
+    void append(const QRect &bounds);
+    void removeLast();
+    void clear();
+    // Forgets the first `count` ids and renumbers the rest from 0
+    void dropFront(int count);
+
+    int count() const { return m_bounds.size(); }
+    QRect bounds(int id) const { return m_bounds.at(id); }
+
+    // Ids of all strokes whose bounds intersect `rect`, in history order
+    QVector<int> query(const QRect &rect) const;
+
+private:
+    static quint64 cellKey(int x, int y);
+    QRect cellRange(const QRect &bounds) const;
+
+    int m_cellSize;
+    QVector<QRect> m_bounds;
+    QHash<quint64, QVector<int>> m_cells;
+};
+
+#endif // SPATIALINDEX_H
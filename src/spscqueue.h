@@ -0,0 +1,43 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QAtomicInteger>
+#include <array>
+
+// Bounded lock-free ring buffer for exactly one producer thread and one consumer
+// thread. Indices grow freely and wrap through the power-of-two mask, so full and
+// empty are told apart without a spare slot.
+template <typename T, int Capacity>
+class SpscQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // Producer side; returns false instead of blocking when the queue is full
+    bool push(const T &value)
+    {
+        const quint32 head = m_head.loadRelaxed();
+        if (head - m_tail.loadAcquire() == quint32(Capacity)) return false;
+        m_buffer[head & (Capacity - 1)] = value;
+        m_head.storeRelease(head + 1);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T *value)
+    {
+        const quint32 tail = m_tail.loadRelaxed();
+        if (tail == m_head.loadAcquire()) return false;
+        *value = m_buffer[tail & (Capacity - 1)];
+        m_tail.storeRelease(tail + 1);
+        return true;
+    }
+
+private:
+    std::array<T, Capacity> m_buffer;
+    // Kept on separate cache lines so the two threads don't false-share
+    alignas(64) QAtomicInteger<quint32> m_head;
+    alignas(64) QAtomicInteger<quint32> m_tail;
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,269 @@
+#include "strokestore.h"
+#include "geometry.h"
+#include <algorithm>
+#include <iterator>
+
+StrokeStore::StrokeStore()
+    : m_pointOffsets({ 0 }), m_shapeOffsets({ 0 }), m_eraseOffsets({ 0 }), m_top(0)
+{
+}
+
+StrokeView StrokeStore::at(int index) const
+{
+    const quint32 style = m_styles[index];
+    const Tool strokeTool = static_cast<Tool>(style & 0xFF);
+    const int size = int(style >> 8);
+    const qint32 textId = m_textIds[index];
+    return {
+        m_points.constData() + m_pointOffsets[index],
+        pointCount(index),
+        QColor::fromRgba(m_colors[index]),
+        strokeTool == Tool::Text ? 0 : size,
+        strokeTool,
+        textId >= 0 ? m_texts[textId] : QString(),
+        strokeTool == Tool::Text ? size : 0,
+        &m_pens[m_penIds[index]],
+        m_shapeOffsets[index + 1] > m_shapeOffsets[index] ? m_shapePoints.constData() + m_shapeOffsets[index] : nullptr
+    };
+}
+
+void StrokeStore::append(const StrokeView &stroke)
+{
+    discardRedo();
+
+    std::copy(stroke.points, stroke.points + stroke.pointCount, std::back_inserter(m_points));
+    m_pointOffsets.append(quint32(m_points.size()));
+    m_colors.append(stroke.color.rgba());
+    const int size = stroke.tool == Tool::Text ? stroke.textSize : stroke.penWidth;
+    m_styles.append(quint32(static_cast<int>(stroke.tool)) | (quint32(std::clamp(size, 0, 0xFFFFFF)) << 8));
+
+    qint32 textId = -1;
+    if (!stroke.text.isEmpty()) {
+        auto it = m_textLookup.constFind(stroke.text);
+        if (it == m_textLookup.constEnd()) {
+            textId = m_texts.size();
+            m_texts.append(stroke.text);
+            m_textLookup.insert(stroke.text, textId);
+        } else {
+            textId = it.value();
+        }
+    }
+    m_textIds.append(textId);
+
+    // Most strokes share a handful of pens; building one per draw costs an allocation
+    const QPair<QRgb, int> penKey(stroke.color.rgba(), stroke.penWidth);
+    qint32 penId = m_penLookup.value(penKey, -1);
+    if (penId < 0) {
+        penId = m_pens.size();
+        m_pens.append(QPen(stroke.color, stroke.penWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+        m_penLookup.insert(penKey, penId);
+    }
+    m_penIds.append(penId);
+
+    if (stroke.tool == Tool::Arrow && stroke.pointCount > 1) {
+        const QLineF line(stroke.points[0], stroke.points[stroke.pointCount - 1]);
+        m_shapePoints.append(Geometry::arrowHead(line, stroke.penWidth * 3));
+    }
+    m_shapeOffsets.append(quint32(m_shapePoints.size()));
+    m_erasedBy.append(-1);
+    m_eraseOffsets.append(quint32(m_erasedIds.size()));
+
+    ++m_top;
+}
+
+void StrokeStore::appendErase()
+{
+    append({ nullptr, 0, QColor(), 0, Tool::ObjectEraser });
+}
+
+void StrokeStore::eraseStroke(int index)
+{
+    const int op = m_top - 1;
+    if (op < 0 || op + 1 != m_colors.size() || tool(op) != Tool::ObjectEraser) return;
+    if (index >= op || isErased(index)) return;
+    m_erasedBy[index] = op;
+    m_erasedIds.append(index);
+    m_eraseOffsets[op + 1] = quint32(m_erasedIds.size());
+}
+
+QVector<int> StrokeStore::erasedStrokes(int index) const
+{
+    return QVector<int>(m_erasedIds.constBegin() + m_eraseOffsets[index], m_erasedIds.constBegin() + m_eraseOffsets[index + 1]);
+}
+
+bool StrokeStore::canReplayFrom(int base) const
+{
+    for (quint32 i = m_eraseOffsets[base]; i < m_eraseOffsets[m_top]; ++i) {
+        if (m_erasedIds[i] < base) return false;
+    }
+    return true;
+}
+
+bool StrokeStore::undo()
+{
+    if (m_top == 0) return false;
+    --m_top;
+    return true;
+}
+
+bool StrokeStore::redo()
+{
+    if (m_top == m_colors.size()) return false;
+    ++m_top;
+    return true;
+}
+
+void StrokeStore::removeLast()
+{
+    if (m_top == 0) return;
+    truncate(m_top - 1);
+}
+
+void StrokeStore::discardRedo()
+{
+    truncate(m_top);
+}
+
+bool StrokeStore::canDropFront(int count) const
+{
+    for (quint32 i = m_eraseOffsets[count]; i < quint32(m_erasedIds.size()); ++i) {
+        if (m_erasedIds[i] < count) return false;
+    }
+    return true;
+}
+
+void StrokeStore::dropFront(int count)
+{
+    count = std::min(count, m_top);
+    if (count <= 0) return;
+
+    dropRange(m_points, m_pointOffsets, count);
+    dropRange(m_shapePoints, m_shapeOffsets, count);
+    dropRange(m_erasedIds, m_eraseOffsets, count);
+    m_colors.remove(0, count);
+    m_styles.remove(0, count);
+    m_textIds.remove(0, count);
+    m_penIds.remove(0, count);
+    m_erasedBy.remove(0, count);
+    // Erase entries only point at later strokes, so everything left shifts down together
+    for (qint32 &id : m_erasedIds) id -= count;
+    for (qint32 &by : m_erasedBy) {
+        if (by >= 0) by -= count;
+    }
+
+    // Text nobody refers to anymore is the bulk of what would otherwise be left behind
+    QVector<QString> texts;
+    QHash<qint32, qint32> textMap;
+    m_textLookup.clear();
+    for (qint32 &textId : m_textIds) {
+        if (textId < 0) continue;
+        auto it = textMap.constFind(textId);
+        if (it == textMap.constEnd()) {
+            it = textMap.insert(textId, texts.size());
+            texts.append(m_texts[textId]);
+            m_textLookup.insert(texts.last(), it.value());
+        }
+        textId = it.value();
+    }
+    m_texts = texts;
+
+    // Removing from the front keeps the old allocations; give the memory back for real
+    m_points.squeeze();
+    m_pointOffsets.squeeze();
+    m_colors.squeeze();
+    m_styles.squeeze();
+    m_textIds.squeeze();
+    m_penIds.squeeze();
+    m_shapePoints.squeeze();
+    m_shapeOffsets.squeeze();
+    m_erasedBy.squeeze();
+    m_erasedIds.squeeze();
+    m_eraseOffsets.squeeze();
+
+    m_top -= count;
+}
+
+template <typename T>
+void StrokeStore::dropRange(QVector<T> &items, QVector<quint32> &offsets, int count)
+{
+    const quint32 base = offsets[count];
+    items.remove(0, base);
+    offsets.remove(0, count);
+    for (quint32 &offset : offsets) offset -= base;
+}
+
+void StrokeStore::clear()
+{
+    m_points.clear();
+    m_pointOffsets = { 0 };
+    m_colors.clear();
+    m_styles.clear();
+    m_textIds.clear();
+    m_texts.clear();
+    m_textLookup.clear();
+    m_penIds.clear();
+    m_pens.clear();
+    m_penLookup.clear();
+    m_shapePoints.clear();
+    m_shapeOffsets = { 0 };
+    m_erasedBy.clear();
+    m_erasedIds.clear();
+    m_eraseOffsets = { 0 };
+    m_top = 0;
+}
+
+void StrokeStore::truncate(int strokeCount)
+{
+    if (strokeCount >= m_colors.size()) {
+        m_top = std::min(m_top, strokeCount);
+        return;
+    }
+    // Strokes erased by entries that are going away become plain strokes again
+    for (quint32 i = m_eraseOffsets[strokeCount]; i < quint32(m_erasedIds.size()); ++i) {
+        m_erasedBy[m_erasedIds[i]] = -1;
+    }
+    // Interned text and pens are kept; they are only dropped by clear()
+    m_points.resize(m_pointOffsets[strokeCount]);
+    m_pointOffsets.resize(strokeCount + 1);
+    m_colors.resize(strokeCount);
+    m_styles.resize(strokeCount);
+    m_textIds.resize(strokeCount);
+    m_penIds.resize(strokeCount);
+    m_shapePoints.resize(m_shapeOffsets[strokeCount]);
+    m_shapeOffsets.resize(strokeCount + 1);
+    m_erasedBy.resize(strokeCount);
+    m_erasedIds.resize(m_eraseOffsets[strokeCount]);
+    m_eraseOffsets.resize(strokeCount + 1);
+    m_top = std::min(m_top, strokeCount);
+}
+
+qint64 StrokeStore::memoryUsage() const
+{
+    // Sizes rather than capacities, so the figure follows what compaction drops
+    qint64 bytes = m_points.size() * qint64(sizeof(QPoint))
+                 + m_pointOffsets.size() * qint64(sizeof(quint32))
+                 + m_colors.size() * qint64(sizeof(QRgb))
+                 + m_styles.size() * qint64(sizeof(quint32))
+                 + m_textIds.size() * qint64(sizeof(qint32))
+                 + m_penIds.size() * qint64(sizeof(qint32))
+                 + m_pens.size() * qint64(sizeof(QPen))
+                 + m_shapePoints.size() * qint64(sizeof(QPointF))
+                 + m_shapeOffsets.size() * qint64(sizeof(quint32))
+                 + m_erasedBy.size() * qint64(sizeof(qint32))
+                 + m_erasedIds.size() * qint64(sizeof(qint32))
+                 + m_eraseOffsets.size() * qint64(sizeof(quint32));
+    for (const QString &text : m_texts) {
+        bytes += text.size() * qint64(sizeof(QChar));
+    }
+    return bytes;
+}
+
+qint64 StrokeStore::frontMemoryUsage(int count) const
+{
+    count = std::clamp(count, 0, int(m_colors.size()));
+    const qint64 perEntry = sizeof(quint32) * 4 + sizeof(QRgb) + sizeof(qint32) * 3;
+    return m_pointOffsets[count] * qint64(sizeof(QPoint))
+         + m_shapeOffsets[count] * qint64(sizeof(QPointF))
+         + m_eraseOffsets[count] * qint64(sizeof(qint32))
+         + count * perEntry;
+}
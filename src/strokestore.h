@@ -0,0 +1,111 @@
+#ifndef STROKESTORE_H
+#define STROKESTORE_H
+
+#include <QPoint>
+#include <QVector>
+#include <QColor>
+#include <QPen>
+#include <QPointF>
+#include <QString>
+#include <QHash>
+
+// Define Tool enum accessible by other classes
+enum class Tool {
+    Pen,
+    Eraser,
+    ObjectEraser,
+    Text,
+    Line,
+    Arrow,
+    Rectangle,
+    Circle
+};
+
+// Non-owning view of one stroke: its points, color, width and the tool used.
+// Points belong to whoever produced the view (the store's arena or the live input).
+struct StrokeView {
+    const QPoint *points;
+    int pointCount;
+    QColor color;
+    int penWidth;
+    Tool tool;
+    QString text;
+    int textSize; // For text tool
+    // Render-ready data the store prepares once at commit; null for live strokes
+    const QPen *pen;
+    const QPointF *arrowHead; // Three points for arrows
+};
+
+// History of committed strokes, stored as a structure of arrays. All points live in
+// one arena, each stroke is a range into it plus packed style attributes, and text
+// and pens are interned. Strokes [0, count()) are on the canvas; the rest are the redo stack,
+// so undo and redo only move the boundary between the two.
+// Object erasing is an entry of its own (tool ObjectEraser, no points) that lists the
+// strokes it removed. Each stroke remembers which entry erased it, so it is hidden
+// exactly while that entry is below the boundary, and undo needs no bookkeeping.
+class StrokeStore
+{
+public:
+    StrokeStore();
+
+    int count() const { return m_top; }
+    int redoCount() const { return m_colors.size() - m_top; }
+    bool isEmpty() const { return m_top == 0; }
+
+    StrokeView at(int index) const;
+    int pointCount(int index) const { return int(m_pointOffsets[index + 1] - m_pointOffsets[index]); }
+    Tool tool(int index) const { return static_cast<Tool>(m_styles[index] & 0xFF); }
+    bool isErased(int index) const { return m_erasedBy[index] >= 0 && m_erasedBy[index] < m_top; }
+    // Strokes removed by the erase entry at `index`
+    QVector<int> erasedStrokes(int index) const;
+    // Whether a raster of the first `base` entries plus replaying [base, count()) gives the
+    // current picture, i.e. nothing after `base` erased a stroke before it
+    bool canReplayFrom(int base) const;
+    // Whether the first `count` strokes can be dropped: no entry after them, redo stack
+    // included, erased one of them
+    bool canDropFront(int count) const;
+
+    // Appends after the current position, discarding anything that could be redone
+    void append(const StrokeView &stroke);
+    // Starts an empty erase entry; eraseStroke() adds to it while it is the last one
+    void appendErase();
+    void eraseStroke(int index);
+    bool undo();
+    bool redo();
+    // Drops the last stroke without making it redoable
+    void removeLast();
+    void discardRedo();
+    void clear();
+    // Forgets the first `count` strokes and renumbers the rest from 0
+    void dropFront(int count);
+
+    int totalPoints() const { return int(m_pointOffsets[m_top]); }
+    // Including strokes on the redo stack
+    int storedPoints() const { return int(m_points.size()); }
+    qint64 memoryUsage() const;
+    // What dropFront(count) would give back, text and pens aside
+    qint64 frontMemoryUsage(int count) const;
+
+private:
+    void truncate(int strokeCount);
+    template <typename T> static void dropRange(QVector<T> &items, QVector<quint32> &offsets, int count);
+
+    QVector<QPoint> m_points;
+    QVector<quint32> m_pointOffsets; // One more entry than strokes; stroke i is [i, i + 1)
+    QVector<QRgb> m_colors;
+    QVector<quint32> m_styles;       // Tool in the low byte, pen width or text size above it
+    QVector<qint32> m_textIds;       // -1 for strokes without text
+    QVector<QString> m_texts;
+    QHash<QString, qint32> m_textLookup;
+    QVector<qint32> m_penIds;
+    QVector<QPen> m_pens;
+    QHash<QPair<QRgb, int>, qint32> m_penLookup;
+    QVector<QPointF> m_shapePoints;  // Arrowheads, in the same layout as m_points
+    QVector<quint32> m_shapeOffsets;
+    QVector<qint32> m_erasedBy;      // Erase entry that removed each stroke, or -1
+    QVector<qint32> m_erasedIds;     // Targets of erase entries, in the same layout as m_points
+    QVector<quint32> m_eraseOffsets;
+    int m_top;
+};
+
+#endif // STROKESTORE_H
@@ -0,0 +1,168 @@
+#include "tilecache.h"
+#include <cmath>
+#include <algorithm>
+
+TileCache::TileCache(int tileSize)
+    : m_tileSize(tileSize), m_dpr(0), m_columns(0), m_rows(0),
+      m_dotsPerMeterX(0), m_dotsPerMeterY(0), m_nextVersion(1), m_dirtyCount(0)
+{
+}
+
+void TileCache::reset(const QSize &size, qreal dpr, int logicalDpiX, int logicalDpiY)
+{
+    m_size = size;
+    m_dpr = dpr;
+    m_deviceSize = size * dpr;
+    m_columns = (m_deviceSize.width() + m_tileSize - 1) / m_tileSize;
+    m_rows = (m_deviceSize.height() + m_tileSize - 1) / m_tileSize;
+    // Match the widget's logical DPI so point-sized text renders as it would on screen
+    m_dotsPerMeterX = qRound(logicalDpiX / 0.0254);
+    m_dotsPerMeterY = qRound(logicalDpiY / 0.0254);
+
+    m_tiles = QVector<QImage>(m_columns * m_rows);
+    m_dirty = QVector<bool>(m_tiles.size(), true);
+    m_dirtyCount = m_tiles.size();
+    // Fresh versions, so nothing rendered for the old grid is accepted
+    m_versions = QVector<quint64>(m_tiles.size(), m_nextVersion++);
+}
+
+QRect TileCache::deviceRect(int tile) const
+{
+    const int column = tile % m_columns;
+    const int row = tile / m_columns;
+    return QRect(column * m_tileSize, row * m_tileSize, m_tileSize, m_tileSize)
+        .intersected(QRect(QPoint(0, 0), m_deviceSize));
+}
+
+QRectF TileCache::tileRect(int tile) const
+{
+    const QRect rect = deviceRect(tile);
+    return QRectF(QPointF(rect.topLeft()) / m_dpr, QSizeF(rect.size()) / m_dpr);
+}
+
+TileCache::Geometry TileCache::geometry(int tile) const
+{
+    return { tileRect(tile), deviceRect(tile).size(), m_dpr, m_dotsPerMeterX, m_dotsPerMeterY };
+}
+
+QVector<int> TileCache::tilesIn(const QRect &rect) const
+{
+    QVector<int> result;
+    const QRect clipped = rect.intersected(QRect(QPoint(0, 0), m_size));
+    if (clipped.isEmpty() || m_tiles.isEmpty()) return result;
+
+    const int left = int(std::floor(clipped.left() * m_dpr)) / m_tileSize;
+    const int top = int(std::floor(clipped.top() * m_dpr)) / m_tileSize;
+    const int right = std::min(m_columns - 1, (int(std::ceil((clipped.right() + 1) * m_dpr)) - 1) / m_tileSize);
+    const int bottom = std::min(m_rows - 1, (int(std::ceil((clipped.bottom() + 1) * m_dpr)) - 1) / m_tileSize);
+    for (int row = top; row <= bottom; ++row) {
+        for (int column = left; column <= right; ++column) {
+            result.append(row * m_columns + column);
+        }
+    }
+    return result;
+}
+
+void TileCache::invalidate(const QRect &rect)
+{
+    for (int tile : tilesIn(rect)) {
+        markDirty(tile);
+    }
+}
+
+void TileCache::invalidateAll()
+{
+    for (int tile = 0; tile < m_tiles.size(); ++tile) {
+        markDirty(tile);
+    }
+}
+
+void TileCache::markDirty(int tile)
+{
+    m_versions[tile] = m_nextVersion++;
+    if (!m_dirty[tile]) {
+        m_dirty[tile] = true;
+        ++m_dirtyCount;
+    }
+}
+
+QVector<int> TileCache::dirtyTiles() const
+{
+    QVector<int> result;
+    if (m_dirtyCount == 0) return result;
+    for (int tile = 0; tile < m_dirty.size(); ++tile) {
+        if (m_dirty[tile]) result.append(tile);
+    }
+    return result;
+}
+
+void TileCache::setTile(int tile, const QImage &image)
+{
+    m_tiles[tile] = image;
+    if (m_dirty[tile]) {
+        m_dirty[tile] = false;
+        --m_dirtyCount;
+    }
+}
+
+QImage TileCache::blankImage(const Geometry &geometry)
+{
+    QImage image(geometry.pixelSize, QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(geometry.dpr);
+    image.setDotsPerMeterX(geometry.dotsPerMeterX);
+    image.setDotsPerMeterY(geometry.dotsPerMeterY);
+    image.fill(Qt::transparent);
+    return image;
+}
+
+void TileCache::paint(QPainter &painter, const QRect &exposed) const
+{
+    // Tiles don't overlap and the widget is cleared underneath, so a plain copy is enough
+    const QPainter::CompositionMode mode = painter.compositionMode();
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    for (int tile : tilesIn(exposed)) {
+        const QImage &image = m_tiles[tile];
+        if (!image.isNull()) {
+            painter.drawImage(tileRect(tile).topLeft(), image);
+        }
+    }
+    painter.setCompositionMode(mode);
+}
+
+QImage TileCache::flatten(const QVector<QImage> &tiles) const
+{
+    QImage image(m_deviceSize, QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(m_dpr);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    const int count = int(std::min(tiles.size(), m_tiles.size()));
+    for (int tile = 0; tile < count; ++tile) {
+        if (!tiles[tile].isNull()) {
+            painter.drawImage(tileRect(tile).topLeft(), tiles[tile]);
+        }
+    }
+    return image;
+}
+
+QVector<QImage> TileCache::split(const QImage &image) const
+{
+    QVector<QImage> tiles(m_tiles.size());
+    for (int tile = 0; tile < tiles.size(); ++tile) {
+        tiles[tile] = blankTile(tile);
+        QPainter painter(&tiles[tile]);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+        painter.translate(-tileRect(tile).topLeft());
+        painter.drawImage(QRectF(QPointF(0, 0), QSizeF(image.deviceIndependentSize())), image);
+    }
+    return tiles;
+}
+
+qint64 TileCache::memoryUsage() const
+{
+    qint64 bytes = 0;
+    for (const QImage &image : m_tiles) {
+        bytes += image.sizeInBytes();
+    }
+    return bytes;
+}
@@ -0,0 +1,77 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <QImage>
+#include <QVector>
+#include <QRect>
+#include <QPainter>
+
+// The rasterized canvas split into fixed-size device-pixel tiles, each with its own
+// image and dirty flag, so a change only costs as much as the area it touches.
+// Tiles nothing was ever drawn on stay null and cost no memory.
+class TileCache
+{
+public:
+    // Everything needed to rasterize one tile away from the cache itself
+    struct Geometry {
+        QRectF rect; // Logical coordinates
+        QSize pixelSize;
+        qreal dpr;
+        int dotsPerMeterX;
+        int dotsPerMeterY;
+    };
+
+    explicit TileCache(int tileSize);
+
+    bool matches(const QSize &size, qreal dpr) const { return size == m_size && dpr == m_dpr; }
+    // Drops every tile and marks the whole grid dirty
+    void reset(const QSize &size, qreal dpr, int logicalDpiX, int logicalDpiY);
+
+    int tileCount() const { return m_tiles.size(); }
+    // Tile area in logical coordinates; edges fall on whole device pixels
+    QRectF tileRect(int tile) const;
+    Geometry geometry(int tile) const;
+    QVector<int> tilesIn(const QRect &rect) const;
+
+    void invalidate(const QRect &rect);
+    void invalidateAll();
+    void markDirty(int tile);
+    // Bumped whenever a tile is invalidated, so a rebuild started earlier can tell it is stale
+    quint64 version(int tile) const { return m_versions[tile]; }
+    bool isDirty(int tile) const { return m_dirty[tile]; }
+    bool hasDirtyTiles() const { return m_dirtyCount > 0; }
+    QVector<int> dirtyTiles() const;
+
+    QImage &tile(int tile) { return m_tiles[tile]; }
+    const QVector<QImage> &tiles() const { return m_tiles; }
+    void setTile(int tile, const QImage &image);
+    // A transparent image sized and scaled for the given tile
+    QImage blankTile(int tile) const { return blankImage(geometry(tile)); }
+    static QImage blankImage(const Geometry &geometry);
+
+    void paint(QPainter &painter, const QRect &exposed) const;
+    qint64 memoryUsage() const;
+
+    // Converting tile sets between grids, for keeping a raster across a resize
+    QImage flatten(const QVector<QImage> &tiles) const;
+    QVector<QImage> split(const QImage &image) const;
+
+private:
+    QRect deviceRect(int tile) const;
+
+    int m_tileSize;
+    QSize m_size;
+    qreal m_dpr;
+    QSize m_deviceSize;
+    int m_columns;
+    int m_rows;
+    int m_dotsPerMeterX;
+    int m_dotsPerMeterY;
+    QVector<QImage> m_tiles;
+    QVector<bool> m_dirty;
+    QVector<quint64> m_versions;
+    quint64 m_nextVersion;
+    int m_dirtyCount;
+};
+
+#endif // TILECACHE_H
@@ -0,0 +1,59 @@
+#include "tilerenderer.h"
+#include "canvas.h"
+#include <QPainter>
+#include <QtConcurrent>
+#include "trace.h"
+
+TileRenderer::TileRenderer(QObject *parent)
+    : QObject(parent), m_running(false)
+{
+    connect(&m_watcher, &QFutureWatcher<QImage>::resultReadyAt, this, &TileRenderer::handleResultReady);
+    connect(&m_watcher, &QFutureWatcher<QImage>::finished, this, &TileRenderer::handleFinished);
+}
+
+TileRenderer::~TileRenderer()
+{
+    m_watcher.cancel();
+    m_watcher.waitForFinished();
+}
+
+void TileRenderer::start(const QVector<Job> &jobs, const StrokeStore &strokes, const QFont &font)
+{
+    m_jobs = jobs;
+    m_running = true;
+    // The lambda owns its copies of the store and font, so later edits on the GUI
+    // thread detach from them instead of racing with the workers
+    m_watcher.setFuture(QtConcurrent::mapped(m_jobs, [strokes, font](const Job &job) {
+        return render(job, strokes, font);
+    }));
+}
+
+QImage TileRenderer::render(const Job &job, const StrokeStore &strokes, const QFont &font)
+{
+    TRACE_SCOPE("TileRenderer::render");
+    QImage image = job.image;
+    if (job.strokes.isEmpty()) return image;
+
+    if (image.isNull()) image = TileCache::blankImage(job.geometry);
+    QPainter painter(&image);
+    painter.translate(-job.geometry.rect.topLeft());
+    painter.setRenderHint(QPainter::Antialiasing, true);
+    painter.setFont(font);
+    for (int i : job.strokes) {
+        Canvas::drawStroke(painter, strokes.at(i), job.glyphs.value(i));
+    }
+    return image;
+}
+
+void TileRenderer::handleResultReady(int index)
+{
+    const Job &job = m_jobs.at(index);
+    emit tileRendered(job.tile, job.version, m_watcher.resultAt(index));
+}
+
+void TileRenderer::handleFinished()
+{
+    m_jobs.clear();
+    m_running = false;
+    emit finished();
+}
@@ -0,0 +1,52 @@
+#ifndef TILERENDERER_H
+#define TILERENDERER_H
+
+#include <QObject>
+#include <QFont>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QImage>
+#include <QVector>
+#include "strokestore.h"
+#include "tilecache.h"
+
+// Rasterizes batches of tiles on the global thread pool. Jobs work on an implicitly
+// shared snapshot of the stroke store, so the GUI thread keeps handling input and
+// editing history while a batch runs; finished tiles are handed back one by one.
+class TileRenderer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Job {
+        int tile;
+        quint64 version;
+        TileCache::Geometry geometry;
+        QImage image;         // Keyframe tile to start from, or null for an empty one
+        QVector<int> strokes; // Store indices to draw on top, in history order
+        QHash<int, QImage> glyphs; // Rasterized text strokes by store index
+    };
+
+    explicit TileRenderer(QObject *parent = nullptr);
+    ~TileRenderer();
+
+    bool isRunning() const { return m_running; }
+    void start(const QVector<Job> &jobs, const StrokeStore &strokes, const QFont &font);
+
+    static QImage render(const Job &job, const StrokeStore &strokes, const QFont &font);
+
+signals:
+    void tileRendered(int tile, quint64 version, const QImage &image);
+    void finished();
+
+private slots:
+    void handleResultReady(int index);
+    void handleFinished();
+
+private:
+    QFutureWatcher<QImage> m_watcher;
+    QVector<Job> m_jobs;
+    bool m_running;
+};
+
+#endif // TILERENDERER_H
@@ -0,0 +1,115 @@
+#include "trace.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+#include <QVector>
+#include <QDebug>
+
+QAtomicInt Trace::g_enabled;
+
+namespace {
+
+struct Zone {
+    const char *name;
+    qint64 begin;
+    qint64 end;
+};
+
+// One per thread that ever recorded; the lock is only contended while stop() reads it
+struct Buffer {
+    QMutex mutex;
+    QVector<Zone> zones;
+    int tid;
+    QString threadName;
+};
+
+QMutex g_buffersMutex;
+QVector<Buffer *> g_buffers;
+QElapsedTimer g_clock;
+QString g_path;
+
+Buffer *threadBuffer()
+{
+    thread_local Buffer *buffer = nullptr;
+    if (!buffer) {
+        buffer = new Buffer;
+        QThread *thread = QThread::currentThread();
+        QMutexLocker locker(&g_buffersMutex);
+        buffer->tid = int(g_buffers.size()) + 1;
+        if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread()) {
+            buffer->threadName = "GUI";
+        } else if (!thread->objectName().isEmpty()) {
+            buffer->threadName = thread->objectName();
+        } else {
+            buffer->threadName = QString(thread->metaObject()->className()) + " " + QString::number(buffer->tid);
+        }
+        // Buffers outlive their threads; stop() may run after a worker has exited
+        g_buffers.append(buffer);
+    }
+    return buffer;
+}
+
+} // namespace
+
+void Trace::start(const QString &path)
+{
+#ifdef CRYSTALBOARD_NO_TRACING
+    qWarning() << "Tracing was compiled out (CRYSTALBOARD_TRACING=OFF); no trace will be written to" << path;
+#else
+    g_path = path;
+    g_clock.start();
+    g_enabled.storeRelease(1);
+#endif
+}
+
+qint64 Trace::now()
+{
+    return g_clock.nsecsElapsed();
+}
+
+void Trace::record(const char *name, qint64 beginNs, qint64 endNs)
+{
+    Buffer *buffer = threadBuffer();
+    QMutexLocker locker(&buffer->mutex);
+    buffer->zones.append({ name, beginNs, endNs });
+}
+
+bool Trace::stop()
+{
+    if (!g_enabled.fetchAndStoreAcquire(0)) return true;
+
+    // Complete ("X") events in microseconds, plus a name for every thread
+    QSaveFile file(g_path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write trace" << g_path << file.errorString();
+        return false;
+    }
+    file.write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    QMutexLocker buffersLocker(&g_buffersMutex);
+    for (Buffer *buffer : g_buffers) {
+        QMutexLocker locker(&buffer->mutex);
+        QByteArray json = QStringLiteral("%1{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%2,\"args\":{\"name\":\"%3\"}}")
+            .arg(first ? "" : ",\n").arg(buffer->tid).arg(buffer->threadName).toUtf8();
+        first = false;
+        for (const Zone &zone : buffer->zones) {
+            json += ",\n{\"name\":\"";
+            json += zone.name;
+            json += "\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+            json += QByteArray::number(buffer->tid);
+            json += ",\"ts\":";
+            json += QByteArray::number(zone.begin / 1000.0, 'f', 3);
+            json += ",\"dur\":";
+            json += QByteArray::number((zone.end - zone.begin) / 1000.0, 'f', 3);
+            json += '}';
+        }
+        file.write(json);
+        buffer->zones.clear();
+    }
+    file.write("\n]}\n");
+    return file.commit();
+}
@@ -0,0 +1,46 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QAtomicInt>
+#include <QString>
+#include <QtGlobal>
+
+// Scoped trace zones for the hot paths, exported as Chrome trace JSON (open it in
+// chrome://tracing or ui.perfetto.dev). A zone is one relaxed atomic load while
+// tracing is off, and nothing at all when built with CRYSTALBOARD_NO_TRACING.
+// Zones may be opened on any thread; each thread records into its own buffer.
+namespace Trace {
+    extern QAtomicInt g_enabled;
+
+    inline bool isEnabled() { return g_enabled.loadRelaxed() != 0; }
+    // Starts recording; stop() writes everything recorded to `path`
+    void start(const QString &path);
+    bool stop();
+
+    qint64 now(); // ns since start()
+    // `name` must outlive the trace; string literals do
+    void record(const char *name, qint64 beginNs, qint64 endNs);
+
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name) : m_name(isEnabled() ? name : nullptr), m_begin(m_name ? now() : 0) {}
+        ~Scope() { if (m_name) record(m_name, m_begin, now()); }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        const char *m_name;
+        qint64 m_begin;
+    };
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#ifdef CRYSTALBOARD_NO_TRACING
+#define TRACE_SCOPE(name) do { (void)sizeof(name); } while (false)
+#else
+#define TRACE_SCOPE(name) const Trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#endif
+
+#endif // TRACE_H
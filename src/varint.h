@@ -0,0 +1,76 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <QByteArray>
+#include <QtGlobal>
+#include <algorithm>
+
+// LEB128 varints, with signed values zigzag-encoded so small negatives stay short.
+// Shared by the board file, the journal payloads and input traces.
+namespace Varint {
+
+inline void write(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(char((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+inline void writeSigned(QByteArray &out, qint64 value)
+{
+    write(out, (quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+class Reader
+{
+public:
+    Reader(const uchar *data, qint64 size) : m_data(data), m_end(data + size) {}
+
+    qint64 remaining() const { return m_end - m_data; }
+
+    bool readVarint(quint64 *value)
+    {
+        *value = 0;
+        for (int shift = 0; shift < 64 && m_data < m_end; shift += 7) {
+            const uchar byte = *m_data++;
+            *value |= quint64(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool readSigned(qint64 *value)
+    {
+        quint64 raw;
+        if (!readVarint(&raw)) return false;
+        *value = qint64(raw >> 1) ^ -qint64(raw & 1);
+        return true;
+    }
+
+    // Counts come from the file, so they are checked against what's left before anything is allocated
+    bool readCount(int *count, int minBytesEach)
+    {
+        quint64 raw;
+        if (!readVarint(&raw) || raw > quint64(remaining() / std::max(1, minBytesEach))) return false;
+        *count = int(raw);
+        return true;
+    }
+
+    bool readBytes(qint64 size, const uchar **bytes)
+    {
+        if (size < 0 || size > remaining()) return false;
+        *bytes = m_data;
+        m_data += size;
+        return true;
+    }
+
+private:
+    const uchar *m_data;
+    const uchar *m_end;
+};
+
+} // namespace Varint
+
+#endif // VARINT_H
@@ -0,0 +1,224 @@
+#include <QtTest>
+#include <QLoggingCategory>
+#include <QTemporaryDir>
+#include <climits>
+#include "boardfile.h"
+#include "varint.h"
+
+// Board files round-trip every kind of entry, and anything short of a whole,
+// well-formed file is rejected without touching the board being loaded into
+class TestBoardFile : public QObject
+{
+    Q_OBJECT
+
+private:
+    static StrokeStore sampleBoard();
+    static QImage sampleBase();
+    static QByteArray readFile(const QString &path);
+    static void writeFile(const QString &path, const QByteArray &data);
+
+private slots:
+    void varints();
+    void roundTrip();
+    void entryRoundTrip();
+    void truncated();
+    void corrupt();
+    void badEraseTarget();
+};
+
+StrokeStore TestBoardFile::sampleBoard()
+{
+    StrokeStore store;
+    // Deltas in every direction and far beyond one varint byte
+    const QVector<QPoint> freehand = { { 10, 10 }, { -5, 3 }, { 100000, -70000 }, { 100001, -70000 } };
+    store.append({ freehand.constData(), int(freehand.size()), QColor(255, 0, 0, 128), 5, Tool::Pen, QString(), 0 });
+    const QVector<QPoint> arrow = { { 0, 0 }, { 40, 30 } };
+    store.append({ arrow.constData(), int(arrow.size()), Qt::green, 4, Tool::Arrow, QString(), 0 });
+    const QPoint at(7, 9);
+    store.append({ &at, 1, Qt::white, 0, Tool::Text, QString::fromUtf8("h\xc3\xa9llo \xe2\x9c\x93"), 24 });
+    store.appendErase();
+    store.eraseStroke(1);
+    // On the redo stack, so not part of the saved board
+    store.append({ &at, 1, Qt::blue, 2, Tool::Pen, QString(), 0 });
+    store.undo();
+    return store;
+}
+
+QImage TestBoardFile::sampleBase()
+{
+    QImage base(20, 10, QImage::Format_ARGB32_Premultiplied);
+    base.fill(Qt::transparent);
+    base.setPixel(3, 4, qRgba(255, 255, 255, 255));
+    base.setDevicePixelRatio(2);
+    return base;
+}
+
+QByteArray TestBoardFile::readFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return QByteArray();
+    return file.readAll();
+}
+
+void TestBoardFile::writeFile(const QString &path, const QByteArray &data)
+{
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QCOMPARE(file.write(data), data.size());
+}
+
+void TestBoardFile::varints()
+{
+    const QVector<qint64> values = { 0, 1, -1, 63, -64, 64, 300, -300, INT_MAX, INT_MIN, LLONG_MAX, LLONG_MIN };
+    QByteArray out;
+    for (qint64 value : values) Varint::writeSigned(out, value);
+    Varint::write(out, 0xFFFFFFFFFFFFFFFFull);
+
+    Varint::Reader in(reinterpret_cast<const uchar *>(out.constData()), out.size());
+    for (qint64 value : values) {
+        qint64 read;
+        QVERIFY(in.readSigned(&read));
+        QCOMPARE(read, value);
+    }
+    quint64 big;
+    QVERIFY(in.readVarint(&big));
+    QCOMPARE(big, 0xFFFFFFFFFFFFFFFFull);
+    QCOMPARE(in.remaining(), qint64(0));
+    QVERIFY(!in.readVarint(&big));
+}
+
+void TestBoardFile::roundTrip()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("board.crb");
+    const StrokeStore saved = sampleBoard();
+    QVERIFY(BoardFile::save(path, saved, sampleBase()));
+
+    StrokeStore loaded;
+    QImage base;
+    QVERIFY(BoardFile::load(path, &loaded, &base));
+    QCOMPARE(loaded.count(), saved.count());
+    QCOMPARE(loaded.redoCount(), 0);
+    for (int i = 0; i < saved.count(); ++i) {
+        const StrokeView a = saved.at(i), b = loaded.at(i);
+        QVERIFY(a.tool == b.tool);
+        QCOMPARE(b.color.rgba(), a.color.rgba());
+        QCOMPARE(b.penWidth, a.penWidth);
+        QCOMPARE(b.textSize, a.textSize);
+        QCOMPARE(b.text, a.text);
+        QCOMPARE(b.pointCount, a.pointCount);
+        for (int p = 0; p < a.pointCount; ++p) {
+            QCOMPARE(b.points[p], a.points[p]);
+        }
+    }
+    QCOMPARE(loaded.erasedStrokes(3), QVector<int>({ 1 }));
+    QVERIFY(loaded.isErased(1));
+
+    QCOMPARE(base.size(), QSize(20, 10));
+    QCOMPARE(base.devicePixelRatio(), 2.0);
+    QCOMPARE(base.pixel(3, 4), qRgba(255, 255, 255, 255));
+    QCOMPARE(qAlpha(base.pixel(0, 0)), 0);
+}
+
+void TestBoardFile::entryRoundTrip()
+{
+    const StrokeStore saved = sampleBoard();
+    StrokeStore loaded;
+    for (int i = 0; i < saved.count(); ++i) {
+        QByteArray entry;
+        BoardFile::writeEntry(entry, saved, i);
+        QVERIFY(BoardFile::readEntry(entry, &loaded));
+        // An entry must be consumed exactly
+        entry.append('\0');
+        StrokeStore scratch = loaded;
+        scratch.removeLast();
+        QVERIFY(!BoardFile::readEntry(entry, &scratch));
+    }
+    QCOMPARE(loaded.count(), saved.count());
+    QVERIFY(loaded.isErased(1));
+}
+
+void TestBoardFile::truncated()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("board.crb");
+    QVERIFY(BoardFile::save(path, sampleBoard(), sampleBase()));
+    const QByteArray whole = readFile(path);
+    QVERIFY(!whole.isEmpty());
+
+    QLoggingCategory::setFilterRules("default.warning=false");
+    const StrokeStore untouched = sampleBoard();
+    for (int size = 0; size < whole.size(); ++size) {
+        writeFile(path, whole.left(size));
+        StrokeStore strokes = untouched;
+        QImage base;
+        QVERIFY2(!BoardFile::load(path, &strokes, &base), qPrintable(QString("%1 of %2 bytes").arg(size).arg(whole.size())));
+        QCOMPARE(strokes.count(), untouched.count());
+        QVERIFY(base.isNull());
+    }
+    QLoggingCategory::setFilterRules(QString());
+}
+
+void TestBoardFile::corrupt()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("board.crb");
+    QVERIFY(BoardFile::save(path, sampleBoard(), QImage()));
+    const QByteArray whole = readFile(path);
+
+    QLoggingCategory::setFilterRules("default.warning=false");
+    StrokeStore strokes;
+    QImage base;
+
+    QByteArray badMagic = whole;
+    badMagic[0] = 'X';
+    writeFile(path, badMagic);
+    QVERIFY(!BoardFile::load(path, &strokes, &base));
+
+    QByteArray newer = whole;
+    newer[4] = char(BoardFile::VERSION + 1);
+    writeFile(path, newer);
+    QVERIFY(!BoardFile::load(path, &strokes, &base));
+
+    writeFile(path, whole + QByteArray(1, '\0'));
+    QVERIFY(!BoardFile::load(path, &strokes, &base));
+
+    QVERIFY(!BoardFile::load(dir.filePath("missing.crb"), &strokes, &base));
+    QLoggingCategory::setFilterRules(QString());
+
+    QCOMPARE(strokes.count(), 0);
+    writeFile(path, whole);
+    QVERIFY(BoardFile::load(path, &strokes, &base));
+    QCOMPARE(strokes.count(), 4);
+}
+
+void TestBoardFile::badEraseTarget()
+{
+    // An erase entry may only name strokes before it
+    StrokeStore store;
+    const QPoint at(1, 1);
+    store.append({ &at, 1, Qt::white, 2, Tool::Pen, QString(), 0 });
+
+    QByteArray entry;
+    Varint::write(entry, quint64(Tool::ObjectEraser));
+    entry.append(4, '\0');
+    Varint::write(entry, 1);
+    Varint::writeSigned(entry, 1); // Itself
+    QVERIFY(!BoardFile::readEntry(entry, &store));
+
+    QByteArray valid;
+    Varint::write(valid, quint64(Tool::ObjectEraser));
+    valid.append(4, '\0');
+    Varint::write(valid, 1);
+    Varint::writeSigned(valid, 0);
+    StrokeStore fresh;
+    fresh.append({ &at, 1, Qt::white, 2, Tool::Pen, QString(), 0 });
+    QVERIFY(BoardFile::readEntry(valid, &fresh));
+    QVERIFY(fresh.isErased(0));
+}
+
+QTEST_MAIN(TestBoardFile)
+#include "tst_boardfile.moc"
@@ -0,0 +1,138 @@
+#include <QtTest>
+#include <QDir>
+#include <QLoggingCategory>
+#include <QTemporaryDir>
+#include "boardfile.h"
+#include "journal.h"
+
+// Records survive a restart, a record torn by a crash is dropped rather than
+// misread, snapshots start a new generation, and one process owns a directory
+class TestJournal : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void replay();
+    void tornRecord();
+    void snapshotRollover();
+    void lock();
+};
+
+void TestJournal::replay()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    {
+        Journal journal(dir.path(), 0);
+        QVERIFY(journal.isLocked());
+        QVERIFY(journal.readRecords().isEmpty());
+        journal.start();
+        journal.append(Journal::Commit, "stroke");
+        journal.append(Journal::Undo);
+    } // Destroying the journal writes out everything queued
+
+    Journal journal(dir.path(), 0);
+    const QVector<QByteArray> records = journal.readRecords();
+    QCOMPARE(records.size(), 2);
+    QCOMPARE(records[0], QByteArray(1, char(Journal::Commit)) + "stroke");
+    QCOMPARE(records[1], QByteArray(1, char(Journal::Undo)));
+    QCOMPARE(journal.recordsSinceSnapshot(), 2);
+}
+
+void TestJournal::tornRecord()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    {
+        Journal journal(dir.path(), 0);
+        journal.readRecords();
+        journal.start();
+        journal.append(Journal::Commit, "first");
+        journal.append(Journal::Clear);
+    }
+
+    // A crash in the middle of a write: the length promises more than made it to disk
+    {
+        QFile log(QDir(dir.path()).filePath("journal-0.log"));
+        QVERIFY(log.open(QIODevice::Append));
+        const char torn[] = { 100, 0, 0, 0, char(Journal::Commit), 'x', 'y' };
+        QCOMPARE(log.write(torn, sizeof(torn)), qint64(sizeof(torn)));
+    }
+
+    QLoggingCategory::setFilterRules("default.warning=false");
+    {
+        Journal journal(dir.path(), 0);
+        const QVector<QByteArray> records = journal.readRecords();
+        QCOMPARE(records.size(), 2);
+        QCOMPARE(records[1], QByteArray(1, char(Journal::Clear)));
+        // Appending resumes after the last whole record, over the torn one
+        journal.start();
+        journal.append(Journal::Redo, "again");
+    }
+    QLoggingCategory::setFilterRules(QString());
+
+    Journal journal(dir.path(), 0);
+    const QVector<QByteArray> records = journal.readRecords();
+    QCOMPARE(records.size(), 3);
+    QCOMPARE(records[0], QByteArray(1, char(Journal::Commit)) + "first");
+    QCOMPARE(records[2], QByteArray(1, char(Journal::Redo)) + "again");
+}
+
+void TestJournal::snapshotRollover()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    {
+        Journal journal(dir.path(), 0);
+        journal.readRecords();
+        journal.start();
+        journal.append(Journal::Commit, "before");
+
+        StrokeStore strokes;
+        const QPoint at(3, 4);
+        strokes.append({ &at, 1, Qt::red, 2, Tool::Pen, QString(), 0 });
+        journal.snapshot(strokes, QImage());
+        QCOMPARE(journal.recordsSinceSnapshot(), 0);
+        journal.append(Journal::Undo);
+    }
+
+    // Only the new generation is left
+    const QStringList files = QDir(dir.path()).entryList({ "snapshot-*.crb", "journal-*.log" }, QDir::Files, QDir::Name);
+    QCOMPARE(files, QStringList({ "journal-1.log", "snapshot-1.crb" }));
+
+    Journal journal(dir.path(), 0);
+    QVERIFY(journal.snapshotPath().endsWith("snapshot-1.crb"));
+    StrokeStore strokes;
+    QImage base;
+    QVERIFY(BoardFile::load(journal.snapshotPath(), &strokes, &base));
+    QCOMPARE(strokes.count(), 1);
+    QCOMPARE(strokes.at(0).points[0], QPoint(3, 4));
+    const QVector<QByteArray> records = journal.readRecords();
+    QCOMPARE(records.size(), 1);
+    QCOMPARE(records[0], QByteArray(1, char(Journal::Undo)));
+}
+
+void TestJournal::lock()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    auto *owner = new Journal(dir.path(), 0);
+    QVERIFY(owner->isLocked());
+    owner->readRecords();
+    owner->start();
+    owner->append(Journal::Commit, "mine");
+
+    {
+        // A second instance must neither take over nor clean up the owner's files
+        Journal intruder(dir.path(), 0);
+        QVERIFY(!intruder.isLocked());
+    }
+    delete owner;
+
+    Journal next(dir.path(), 0);
+    QVERIFY(next.isLocked());
+    QCOMPARE(next.readRecords().size(), 1);
+}
+
+QTEST_MAIN(TestJournal)
+#include "tst_journal.moc"
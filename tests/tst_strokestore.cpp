@@ -0,0 +1,138 @@
+#include <QtTest>
+#include "strokestore.h"
+
+// Undo, redo and compaction across object-erase entries, which tie strokes to
+// the entry that removed them by index
+class TestStrokeStore : public QObject
+{
+    Q_OBJECT
+
+private:
+    static void appendPen(StrokeStore &store, const QVector<QPoint> &points)
+    {
+        store.append({ points.constData(), int(points.size()), Qt::white, 3, Tool::Pen, QString(), 0 });
+    }
+
+private slots:
+    void undoRedo();
+    void appendDiscardsRedo();
+    void eraseFollowsUndoBoundary();
+    void removeLastRestoresErased();
+    void dropFrontRemapsErase();
+    void dropFrontMemory();
+};
+
+void TestStrokeStore::undoRedo()
+{
+    StrokeStore store;
+    appendPen(store, { { 0, 0 }, { 10, 10 } });
+    appendPen(store, { { 5, 5 } });
+    QCOMPARE(store.count(), 2);
+    QCOMPARE(store.totalPoints(), 3);
+
+    QVERIFY(store.undo());
+    QCOMPARE(store.count(), 1);
+    QCOMPARE(store.redoCount(), 1);
+    QCOMPARE(store.totalPoints(), 2);
+    QCOMPARE(store.storedPoints(), 3);
+
+    QVERIFY(store.redo());
+    QVERIFY(!store.redo());
+    QCOMPARE(store.count(), 2);
+    QCOMPARE(store.at(1).points[0], QPoint(5, 5));
+}
+
+void TestStrokeStore::appendDiscardsRedo()
+{
+    StrokeStore store;
+    appendPen(store, { { 0, 0 } });
+    appendPen(store, { { 1, 1 } });
+    store.undo();
+    appendPen(store, { { 2, 2 }, { 3, 3 } });
+    QCOMPARE(store.count(), 2);
+    QCOMPARE(store.redoCount(), 0);
+    QCOMPARE(store.storedPoints(), 3);
+    QCOMPARE(store.at(1).points[1], QPoint(3, 3));
+}
+
+void TestStrokeStore::eraseFollowsUndoBoundary()
+{
+    StrokeStore store;
+    appendPen(store, { { 0, 0 } });
+    appendPen(store, { { 1, 1 } });
+    store.appendErase();
+    store.eraseStroke(0);
+    store.eraseStroke(0); // Already erased
+    QVERIFY(store.tool(2) == Tool::ObjectEraser);
+    QCOMPARE(store.erasedStrokes(2), QVector<int>({ 0 }));
+    QVERIFY(store.isErased(0));
+    QVERIFY(!store.isErased(1));
+    // The erase entry only replays from before the stroke it removed
+    QVERIFY(!store.canReplayFrom(1));
+    QVERIFY(store.canReplayFrom(0));
+
+    store.undo();
+    QVERIFY(!store.isErased(0));
+    store.redo();
+    QVERIFY(store.isErased(0));
+}
+
+void TestStrokeStore::removeLastRestoresErased()
+{
+    StrokeStore store;
+    appendPen(store, { { 0, 0 } });
+    store.appendErase();
+    store.eraseStroke(0);
+    store.removeLast();
+    QCOMPARE(store.count(), 1);
+    QCOMPARE(store.redoCount(), 0);
+    QVERIFY(!store.isErased(0));
+}
+
+void TestStrokeStore::dropFrontRemapsErase()
+{
+    StrokeStore store;
+    appendPen(store, { { 0, 0 } });
+    appendPen(store, { { 1, 1 } });
+    appendPen(store, { { 2, 2 }, { 4, 4 } });
+    store.appendErase();
+    store.eraseStroke(2);
+    appendPen(store, { { 3, 3 } });
+    store.undo(); // Keep something on the redo stack
+
+    // Stroke 2 is erased by a later entry, so the front can only go up to it
+    QVERIFY(store.canDropFront(2));
+    QVERIFY(!store.canDropFront(3));
+
+    store.dropFront(2);
+    QCOMPARE(store.count(), 2);
+    QCOMPARE(store.redoCount(), 1);
+    QCOMPARE(store.at(0).points[1], QPoint(4, 4));
+    QCOMPARE(store.erasedStrokes(1), QVector<int>({ 0 }));
+    QVERIFY(store.isErased(0));
+
+    store.undo();
+    QVERIFY(!store.isErased(0));
+    store.redo();
+    store.redo();
+    QCOMPARE(store.count(), 3);
+    QCOMPARE(store.at(2).points[0], QPoint(3, 3));
+    QVERIFY(store.isErased(0));
+}
+
+void TestStrokeStore::dropFrontMemory()
+{
+    StrokeStore store;
+    for (int i = 0; i < 100; ++i) {
+        appendPen(store, { { i, 0 }, { i, 10 }, { i, 20 } });
+    }
+    const qint64 before = store.memoryUsage();
+    const qint64 front = store.frontMemoryUsage(60);
+    QVERIFY(front > 0);
+    store.dropFront(60);
+    QCOMPARE(store.memoryUsage(), before - front);
+    QCOMPARE(store.at(0).points[0], QPoint(60, 0));
+}
+
+QTEST_MAIN(TestStrokeStore)
+#include "tst_strokestore.moc"